@@ -0,0 +1,128 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "dynamicwallpaperdescription.h"
+#include "dynamicwallpaperengine.h"
+
+#include <KDynamicWallpaperMetaData>
+#include <KDynamicWallpaperMetaDataTable>
+#include <KSunPosition>
+
+#include <QScopedPointer>
+#include <QTest>
+
+class EngineBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void benchmarkCreate_data();
+    void benchmarkCreate();
+    void benchmarkEvaluate_data();
+    void benchmarkEvaluate();
+};
+
+static const QGeoCoordinate s_location(50.45, 30.52);
+
+// The images are spread evenly over a day. Solar images also carry the position of the Sun at
+// their time, so the wallpaper is displayed with the solar engine.
+static DynamicWallpaperDescription makeDescription(int imageCount, bool isSolar)
+{
+    const QDateTime midnight(QDate(2020, 6, 21), QTime(0, 0), Qt::UTC);
+
+    QVector<qint64> epochSeconds;
+    epochSeconds.reserve(imageCount);
+    for (int i = 0; i < imageCount; ++i)
+        epochSeconds.append(midnight.toSecsSinceEpoch() + qint64(86400) * i / imageCount);
+    const QVector<KSunPosition> positions = KSunPosition::compute(epochSeconds, s_location);
+
+    QList<KDynamicWallpaperMetaData> metaData;
+    for (int i = 0; i < imageCount; ++i) {
+        KDynamicWallpaperMetaData md;
+        md.setCrossFadeMode(KDynamicWallpaperMetaData::CrossFade);
+        md.setTime(qreal(i) / imageCount);
+        if (isSolar) {
+            md.setSolarElevation(positions[i].elevation());
+            md.setSolarAzimuth(positions[i].azimuth());
+        }
+        md.setIndex(i);
+        metaData.append(md);
+    }
+
+    return DynamicWallpaperDescription::fromMetaData(QStringLiteral("/tmp/benchmark.avif"),
+                                                     KDynamicWallpaperMetaDataTable(metaData));
+}
+
+void EngineBenchmark::benchmarkCreate_data()
+{
+    QTest::addColumn<int>("imageCount");
+    QTest::addColumn<bool>("isSolar");
+
+    QTest::newRow("solar, 24 images") << 24 << true;
+    QTest::newRow("solar, 240 images") << 240 << true;
+    QTest::newRow("solar, 1440 images") << 1440 << true;
+    QTest::newRow("timed, 24 images") << 24 << false;
+    QTest::newRow("timed, 240 images") << 240 << false;
+    QTest::newRow("timed, 1440 images") << 1440 << false;
+}
+
+void EngineBenchmark::benchmarkCreate()
+{
+    QFETCH(int, imageCount);
+    QFETCH(bool, isSolar);
+
+    const DynamicWallpaperDescription description = makeDescription(imageCount, isSolar);
+    QCOMPARE(description.imageCount(), imageCount);
+    QCOMPARE(bool(description.supportedEngines() & DynamicWallpaperDescription::SolarEngine), isSolar);
+
+    const QDateTime dateTime(QDate(2020, 6, 21), QTime(15, 30), Qt::UTC);
+
+    QBENCHMARK {
+        QScopedPointer<DynamicWallpaperEngine> engine(DynamicWallpaperEngine::create(description, s_location, dateTime));
+        engine->update(dateTime);
+    }
+}
+
+void EngineBenchmark::benchmarkEvaluate_data()
+{
+    QTest::addColumn<bool>("isSolar");
+
+    QTest::newRow("solar") << true;
+    QTest::newRow("timed") << false;
+}
+
+void EngineBenchmark::benchmarkEvaluate()
+{
+    QFETCH(bool, isSolar);
+
+    const DynamicWallpaperDescription description = makeDescription(24, isSolar);
+
+    // A whole year in local time, so the engines go through both DST transitions, if any.
+    const QDateTime from(QDate(2020, 1, 1), QTime(0, 0));
+    const QDateTime to(QDate(2020, 12, 31), QTime(23, 59));
+    const qint64 step = 60;
+
+    QVector<DynamicWallpaperEngine::TimelineEntry> timeline;
+    QBENCHMARK {
+        timeline = DynamicWallpaperEngine::evaluate(description, s_location, from, to, step);
+    }
+
+    QCOMPARE(timeline.count(), int(from.secsTo(to) / step + 1));
+    for (const DynamicWallpaperEngine::TimelineEntry &entry : qAsConst(timeline)) {
+        const QString when = entry.dateTime.toString(Qt::ISODate);
+        QVERIFY2(entry.blendFactor >= 0 && entry.blendFactor <= 1,
+                 qPrintable(QStringLiteral("blend factor %1 at %2").arg(entry.blendFactor).arg(when)));
+        QVERIFY2(entry.bottomLayer.isValid(), qPrintable(QStringLiteral("no bottom layer at %1").arg(when)));
+        if (entry.topLayer.isEmpty())
+            QVERIFY2(qFuzzyIsNull(entry.blendFactor), qPrintable(QStringLiteral("no top layer at %1").arg(when)));
+        else
+            QVERIFY2(entry.topLayer.isValid(), qPrintable(QStringLiteral("invalid top layer at %1").arg(when)));
+    }
+}
+
+QTEST_GUILESS_MAIN(EngineBenchmark)
+
+#include "enginebenchmark.moc"
@@ -0,0 +1,111 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "dynamicwallpaperdescription.h"
+#include "dynamicwallpaperengine.h"
+
+#include <KDynamicWallpaperMetaData>
+#include <KDynamicWallpaperMetaDataTable>
+#include <KSunPosition>
+
+#include <QScopedPointer>
+#include <QSet>
+#include <QTest>
+
+class EngineTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testScheduledUpdates_data();
+    void testScheduledUpdates();
+};
+
+static const QGeoCoordinate s_location(50.45, 30.52);
+
+// The images are spread evenly over a day, half an image apart from the midnight, so the frame
+// that is displayed at midnight wraps around from the previous day. Solar images also carry the
+// position of the Sun at their time, so the wallpaper is displayed with the solar engine.
+static DynamicWallpaperDescription makeDescription(int imageCount, bool isSolar, bool isCrossFade)
+{
+    const QDateTime midnight(QDate(2020, 6, 21), QTime(0, 0), Qt::UTC);
+
+    QVector<qint64> epochSeconds;
+    epochSeconds.reserve(imageCount);
+    for (int i = 0; i < imageCount; ++i)
+        epochSeconds.append(midnight.toSecsSinceEpoch() + qint64(86400) * (2 * i + 1) / (2 * imageCount));
+    const QVector<KSunPosition> positions = KSunPosition::compute(epochSeconds, s_location);
+
+    QList<KDynamicWallpaperMetaData> metaData;
+    for (int i = 0; i < imageCount; ++i) {
+        KDynamicWallpaperMetaData md;
+        md.setCrossFadeMode(isCrossFade ? KDynamicWallpaperMetaData::CrossFade : KDynamicWallpaperMetaData::NoCrossFade);
+        md.setTime((i + 0.5) / imageCount);
+        if (isSolar) {
+            md.setSolarElevation(positions[i].elevation());
+            md.setSolarAzimuth(positions[i].azimuth());
+        }
+        md.setIndex(i);
+        metaData.append(md);
+    }
+
+    return DynamicWallpaperDescription::fromMetaData(QStringLiteral("/tmp/test.avif"),
+                                                     KDynamicWallpaperMetaDataTable(metaData));
+}
+
+void EngineTest::testScheduledUpdates_data()
+{
+    QTest::addColumn<bool>("isSolar");
+    QTest::addColumn<bool>("isCrossFade");
+
+    QTest::newRow("solar, cross-fade") << true << true;
+    QTest::newRow("solar, no cross-fade") << true << false;
+    QTest::newRow("timed, cross-fade") << false << true;
+    QTest::newRow("timed, no cross-fade") << false << false;
+}
+
+void EngineTest::testScheduledUpdates()
+{
+    QFETCH(bool, isSolar);
+    QFETCH(bool, isCrossFade);
+
+    const int imageCount = 24;
+    const DynamicWallpaperDescription description = makeDescription(imageCount, isSolar, isCrossFade);
+
+    // Only update the wallpaper when the engine asks for it, like the wallpaper does, and check
+    // that every image is displayed every day.
+    const QDate firstDay(2020, 6, 19);
+    const int dayCount = 5;
+
+    QScopedPointer<DynamicWallpaperEngine> engine;
+    QDateTime dateTime(firstDay, QTime(0, 0));
+    for (int day = 0; day < dayCount; ++day) {
+        const QDate date = firstDay.addDays(day);
+        QSet<QUrl> displayedImages;
+
+        while (dateTime.date() == date) {
+            if (!engine || engine->isExpired(dateTime))
+                engine.reset(DynamicWallpaperEngine::create(description, s_location, dateTime));
+            QVERIFY(engine);
+
+            engine->update(dateTime);
+            displayedImages.insert(engine->bottomLayer());
+
+            const QDateTime nextUpdate = engine->nextUpdateDateTime();
+            QVERIFY2(nextUpdate > dateTime, qPrintable(dateTime.toString(Qt::ISODate)));
+            dateTime = nextUpdate;
+        }
+
+        for (int i = 0; i < imageCount; ++i) {
+            QVERIFY2(displayedImages.contains(description.imageUrlAt(i)),
+                     qPrintable(QStringLiteral("image %1 is not displayed on %2").arg(i).arg(date.toString(Qt::ISODate))));
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(EngineTest)
+
+#include "enginetest.moc"
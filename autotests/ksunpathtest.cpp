@@ -0,0 +1,132 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <KSunPath>
+#include <KSunPosition>
+
+#include <QTest>
+#include <QtMath>
+
+#include <cmath>
+
+class KSunPathTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testCreate_data();
+    void testCreate();
+    void testPoles_data();
+    void testPoles();
+};
+
+struct SampledPath
+{
+    bool isValid = false;
+    QVector3D center;
+    QVector3D normal;
+    float radius = 0;
+};
+
+// The path that used to be fitted through the positions of the Sun at every hour of the day,
+// kept here as the reference for the closed form one.
+static SampledPath samplePath(const QDateTime &dateTime, const QGeoCoordinate &location)
+{
+    const QDate utcDate = dateTime.toUTC().date();
+
+    QVector<QVector3D> positions;
+    for (int hour = 0; hour < 24; ++hour) {
+        const KSunPosition position(QDateTime(utcDate, QTime(hour, 0), Qt::UTC), location);
+        if (!position.isValid())
+            return SampledPath();
+        positions.append(position.toVector());
+    }
+
+    SampledPath path;
+    for (const QVector3D &position : qAsConst(positions))
+        path.center += position;
+    path.center /= positions.count();
+
+    for (const QVector3D &position : qAsConst(positions))
+        path.radius += path.center.distanceToPoint(position);
+    path.radius /= positions.count();
+
+    for (int i = 1; i < positions.count(); ++i) {
+        const QVector3D cross = QVector3D::crossProduct(positions[i - 1] - path.center, positions[i] - path.center);
+        path.normal += cross.normalized();
+    }
+    path.normal.normalize();
+
+    path.isValid = !qFuzzyIsNull(path.normal.x());
+    return path;
+}
+
+void KSunPathTest::testCreate_data()
+{
+    QTest::addColumn<qreal>("latitude");
+    QTest::addColumn<QDate>("date");
+
+    const QVector<qreal> latitudes { -85, -66.5, -45, -23.5, 0, 23.5, 45, 66.5, 85 };
+    const QVector<QDate> dates {
+        QDate(2020, 3, 20),
+        QDate(2020, 6, 21),
+        QDate(2020, 9, 22),
+        QDate(2020, 12, 21),
+        QDate(2021, 2, 1),
+    };
+
+    for (qreal latitude : latitudes) {
+        for (const QDate &date : dates)
+            QTest::addRow("%g, %s", latitude, qPrintable(date.toString(Qt::ISODate))) << latitude << date;
+    }
+}
+
+void KSunPathTest::testCreate()
+{
+    QFETCH(qreal, latitude);
+    QFETCH(QDate, date);
+
+    const QGeoCoordinate location(latitude, 30.5);
+    const QDateTime dateTime(date, QTime(12, 0), Qt::UTC);
+
+    const SampledPath expected = samplePath(dateTime, location);
+    const KSunPath actual = KSunPath::create(dateTime, location);
+    QVERIFY(expected.isValid);
+    QVERIFY(actual.isValid());
+
+    QVERIFY2(expected.center.distanceToPoint(actual.center()) < 0.01,
+             qPrintable(QStringLiteral("center differs by %1").arg(expected.center.distanceToPoint(actual.center()))));
+    QVERIFY2(std::abs(expected.radius - actual.radius()) < 0.005,
+             qPrintable(QStringLiteral("radius differs by %1").arg(std::abs(expected.radius - actual.radius()))));
+
+    const float cosine = qBound(-1.0f, QVector3D::dotProduct(expected.normal, actual.normal()), 1.0f);
+    const qreal angle = qRadiansToDegrees(std::acos(cosine));
+    QVERIFY2(angle < 1, qPrintable(QStringLiteral("normal differs by %1 degrees").arg(angle)));
+}
+
+void KSunPathTest::testPoles_data()
+{
+    QTest::addColumn<qreal>("latitude");
+
+    QTest::newRow("north pole") << qreal(90);
+    QTest::newRow("south pole") << qreal(-90);
+}
+
+void KSunPathTest::testPoles()
+{
+    QFETCH(qreal, latitude);
+
+    // The celestial pole is at the zenith, so both paths are parallel to the horizon.
+    const QGeoCoordinate location(latitude, 30.5);
+    const QDateTime dateTime(QDate(2020, 6, 21), QTime(12, 0), Qt::UTC);
+
+    QVERIFY(!samplePath(dateTime, location).isValid);
+    QVERIFY(!KSunPath::create(dateTime, location).isValid());
+}
+
+QTEST_GUILESS_MAIN(KSunPathTest)
+
+#include "ksunpathtest.moc"
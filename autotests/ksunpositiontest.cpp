@@ -0,0 +1,112 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <KSunPosition>
+
+#include <QTest>
+#include <QtMath>
+
+#include <cmath>
+
+class KSunPositionTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testCompute_data();
+    void testCompute();
+};
+
+// The angle between the directions to the Sun, in decimal degrees. Unlike the difference of the
+// azimuths, it stays small near the zenith and the nadir, where the azimuth is ill-conditioned.
+static qreal angleBetween(const KSunPosition &a, const KSunPosition &b)
+{
+    auto toVector = [](const KSunPosition &position, qreal *x, qreal *y, qreal *z) {
+        const qreal elevation = qDegreesToRadians(position.elevation());
+        const qreal azimuth = qDegreesToRadians(position.azimuth());
+        *x = std::cos(elevation) * std::cos(azimuth);
+        *y = std::cos(elevation) * std::sin(azimuth);
+        *z = std::sin(elevation);
+    };
+
+    qreal ax, ay, az, bx, by, bz;
+    toVector(a, &ax, &ay, &az);
+    toVector(b, &bx, &by, &bz);
+
+    const qreal chord = std::sqrt((ax - bx) * (ax - bx) + (ay - by) * (ay - by) + (az - bz) * (az - bz));
+    return qRadiansToDegrees(2 * std::asin(qMin(chord / 2, 1.0)));
+}
+
+void KSunPositionTest::testCompute_data()
+{
+    QTest::addColumn<qreal>("latitude");
+    QTest::addColumn<qreal>("longitude");
+    QTest::addColumn<QDate>("date");
+
+    const QVector<qreal> latitudes { -85, -66.5, -45, -23.5, 0, 23.5, 45, 66.5, 85 };
+    const QVector<qreal> longitudes { -122.4, 30.5, 179.9 };
+    const QVector<QDate> dates {
+        QDate(2020, 3, 20),
+        QDate(2020, 6, 21),
+        QDate(2020, 9, 22),
+        QDate(2020, 12, 21),
+        QDate(2021, 2, 1),
+    };
+
+    for (qreal latitude : latitudes) {
+        for (qreal longitude : longitudes) {
+            for (const QDate &date : dates) {
+                QTest::addRow("%g, %g, %s", latitude, longitude, qPrintable(date.toString(Qt::ISODate)))
+                    << latitude << longitude << date;
+            }
+        }
+    }
+}
+
+void KSunPositionTest::testCompute()
+{
+    QFETCH(qreal, latitude);
+    QFETCH(qreal, longitude);
+    QFETCH(QDate, date);
+
+    const QGeoCoordinate location(latitude, longitude);
+
+    // Three days at an odd step, so the samples fall at different times of every day and the
+    // declination and the equation of time are interpolated across a few UTC midnights.
+    const qint64 start = QDateTime(date, QTime(0, 0), Qt::UTC).toSecsSinceEpoch();
+    QVector<qint64> epochSeconds;
+    for (qint64 offset = 0; offset < 3 * 86400; offset += 17 * 60 + 13)
+        epochSeconds.append(start + offset);
+
+    const QVector<KSunPosition> actual = KSunPosition::compute(epochSeconds, location);
+    QCOMPARE(actual.count(), epochSeconds.count());
+
+    for (int i = 0; i < epochSeconds.count(); ++i) {
+        const QDateTime dateTime = QDateTime::fromSecsSinceEpoch(epochSeconds[i], Qt::UTC);
+        const QString when = dateTime.toString(Qt::ISODate);
+        const KSunPosition expected(dateTime, location);
+
+        QVERIFY2(expected.isValid() == actual[i].isValid(), qPrintable(when));
+        if (!expected.isValid())
+            continue;
+
+        // The atmospheric refraction correction jumps by about 0.025 degrees at an elevation of
+        // 5 degrees, skip the samples that happen to end up on different sides of it.
+        if ((expected.elevation() > 5) != (actual[i].elevation() > 5))
+            continue;
+
+        const qreal elevationError = std::abs(expected.elevation() - actual[i].elevation());
+        QVERIFY2(elevationError < 0.005,
+                 qPrintable(QStringLiteral("elevation differs by %1 at %2").arg(elevationError).arg(when)));
+
+        const qreal angle = angleBetween(expected, actual[i]);
+        QVERIFY2(angle < 0.01, qPrintable(QStringLiteral("direction differs by %1 degrees at %2").arg(angle).arg(when)));
+    }
+}
+
+QTEST_GUILESS_MAIN(KSunPositionTest)
+
+#include "ksunpositiontest.moc"
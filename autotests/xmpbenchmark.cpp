@@ -0,0 +1,112 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "kdynamicwallpaperxmp_p.h"
+
+#include <KDynamicWallpaperMetaData>
+#include <KDynamicWallpaperMetaDataTable>
+
+#include <QDomDocument>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTest>
+
+class XmpBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void benchmarkParse_data();
+    void benchmarkParse();
+    void benchmarkParseDom_data();
+    void benchmarkParseDom();
+};
+
+static QByteArray makePacket(int imageCount)
+{
+    QList<KDynamicWallpaperMetaData> metaData;
+    for (int i = 0; i < imageCount; ++i) {
+        KDynamicWallpaperMetaData md;
+        md.setCrossFadeMode(KDynamicWallpaperMetaData::CrossFade);
+        md.setTime(qreal(i) / imageCount);
+        md.setSolarElevation(-60 + 120.0 * i / imageCount);
+        md.setSolarAzimuth(360.0 * i / imageCount);
+        md.setIndex(i);
+        metaData.append(md);
+    }
+    return KDynamicWallpaperXmp::serialize(metaData);
+}
+
+// The parser that was used before the streaming one, kept here as the baseline.
+static QList<KDynamicWallpaperMetaData> parseWithDom(const QByteArray &xmp)
+{
+    QDomDocument xmpDocument;
+    xmpDocument.setContent(xmp);
+    if (xmpDocument.isNull())
+        return QList<KDynamicWallpaperMetaData>();
+
+    const QString attributeName = QStringLiteral("plasma:dynamic-wallpaper-solar");
+    const QDomNodeList descriptionNodes = xmpDocument.elementsByTagName(QStringLiteral("rdf:Description"));
+    for (int i = 0; i < descriptionNodes.count(); ++i) {
+        QDomElement descriptionNode = descriptionNodes.at(i).toElement();
+        const QByteArray base64 = descriptionNode.attribute(attributeName).toUtf8();
+        if (base64.isEmpty())
+            continue;
+
+        const QJsonArray array = QJsonDocument::fromJson(QByteArray::fromBase64(base64)).array();
+        QList<KDynamicWallpaperMetaData> result;
+        for (int j = 0; j < array.size(); ++j) {
+            KDynamicWallpaperMetaData metaData = KDynamicWallpaperMetaData::fromJson(array[j].toObject());
+            if (metaData.isValid())
+                result.append(metaData);
+        }
+        return result;
+    }
+
+    return QList<KDynamicWallpaperMetaData>();
+}
+
+void XmpBenchmark::benchmarkParse_data()
+{
+    QTest::addColumn<int>("imageCount");
+
+    QTest::newRow("24 images") << 24;
+    QTest::newRow("1440 images") << 1440;
+}
+
+void XmpBenchmark::benchmarkParse()
+{
+    QFETCH(int, imageCount);
+
+    const QByteArray xmp = makePacket(imageCount);
+    QCOMPARE(KDynamicWallpaperXmp::parse(xmp).count(), imageCount);
+
+    QBENCHMARK {
+        KDynamicWallpaperXmp::parse(xmp);
+    }
+}
+
+void XmpBenchmark::benchmarkParseDom_data()
+{
+    benchmarkParse_data();
+}
+
+void XmpBenchmark::benchmarkParseDom()
+{
+    QFETCH(int, imageCount);
+
+    const QByteArray xmp = makePacket(imageCount);
+    QCOMPARE(parseWithDom(xmp).count(), imageCount);
+
+    QBENCHMARK {
+        parseWithDom(xmp);
+    }
+}
+
+QTEST_GUILESS_MAIN(XmpBenchmark)
+
+#include "xmpbenchmark.moc"
@@ -6,8 +6,7 @@
 
 #include "dynamicwallpapercrawler.h"
 
-#include <KDynamicWallpaperMetaData>
-#include <KDynamicWallpaperReader>
+#include <KDynamicWallpaperInfo>
 
 #include <QDir>
 
@@ -105,10 +104,10 @@ void DynamicWallpaperCrawler::visitFolder(const QString &filePath)
 
 void DynamicWallpaperCrawler::visitFile(const QString &filePath)
 {
-    // Not every avif file is a dynamic wallpaper, we need to read the file contents to
+    // Not every avif file is a dynamic wallpaper, we need to read the file metadata to
     // determine whether filePath actually points to a dynamic wallpaper file.
-    KDynamicWallpaperReader reader(filePath);
-    if (reader.error() == KDynamicWallpaperReader::NoError)
+    const KDynamicWallpaperInfo info(filePath);
+    if (info.error() == KDynamicWallpaperInfo::NoError)
         emit foundFile(filePath, token());
 }
 
@@ -7,7 +7,16 @@
 #include "dynamicwallpaperdescription.h"
 #include "dynamicwallpaperimagehandle.h"
 
-#include <KDynamicWallpaperReader>
+#include <KDynamicWallpaperInfo>
+
+/*!
+ * \class DynamicWallpaperDescription
+ * \brief The DynamicWallpaperDescription class describes the images of a dynamic wallpaper.
+ *
+ * The metadata is kept in a KDynamicWallpaperMetaDataTable, which stores every field of all
+ * images in a contiguous array, and the urls of the images are built on demand, so wallpapers
+ * with thousands of images don't cost thousands of heap allocations.
+ */
 
 /*!
  * Constructs an invalid DynamicWallpaperDescription object.
@@ -21,7 +30,7 @@ DynamicWallpaperDescription::DynamicWallpaperDescription()
  */
 bool DynamicWallpaperDescription::isValid() const
 {
-    return !m_imageUrls.isEmpty();
+    return !m_metaData.isEmpty();
 }
 
 /*!
@@ -29,13 +38,7 @@ bool DynamicWallpaperDescription::isValid() const
  */
 DynamicWallpaperDescription::EngineTypes DynamicWallpaperDescription::supportedEngines() const
 {
-    EngineTypes types = SolarEngine | TimedEngine;
-    for (const KDynamicWallpaperMetaData &metaData : m_metaData) {
-        // Exclude the solar engine if there's at least one image without solar metadata.
-        if (!(metaData.fields() & KDynamicWallpaperMetaData::SolarAzimuthField))
-            types &= ~SolarEngine;
-    }
-    return types;
+    return m_supportedEngines;
 }
 
 /*!
@@ -45,7 +48,7 @@ DynamicWallpaperDescription::EngineTypes DynamicWallpaperDescription::supportedE
  */
 int DynamicWallpaperDescription::imageCount() const
 {
-    return m_imageUrls.count();
+    return m_metaData.count();
 }
 
 /*!
@@ -56,7 +59,14 @@ int DynamicWallpaperDescription::imageCount() const
  */
 QUrl DynamicWallpaperDescription::imageUrlAt(int imageIndex) const
 {
-    return m_imageUrls.value(imageIndex);
+    if (imageIndex < 0 || imageIndex >= m_imageIndices.count())
+        return QUrl();
+
+    DynamicWallpaperImageHandle handle;
+    handle.setFileName(m_fileName);
+    handle.setImageIndex(m_imageIndices[imageIndex]);
+
+    return handle.toUrl();
 }
 
 /*!
@@ -67,7 +77,60 @@ QUrl DynamicWallpaperDescription::imageUrlAt(int imageIndex) const
  */
 KDynamicWallpaperMetaData DynamicWallpaperDescription::metaDataAt(int imageIndex) const
 {
-    return m_metaData.value(imageIndex);
+    return m_metaData.at(imageIndex);
+}
+
+/*!
+ * Returns the time of the image with the specified index \p imageIndex, without creating a
+ * KDynamicWallpaperMetaData object.
+ *
+ * This method will return \c 0 if the provided index is outside the valid range.
+ */
+qreal DynamicWallpaperDescription::timeAt(int imageIndex) const
+{
+    return m_times.value(imageIndex);
+}
+
+/*!
+ * Returns the solar elevation of the image with the specified index \p imageIndex, without
+ * creating a KDynamicWallpaperMetaData object.
+ *
+ * This method will return \c 0 if the provided index is outside the valid range.
+ */
+qreal DynamicWallpaperDescription::solarElevationAt(int imageIndex) const
+{
+    return m_solarElevations.value(imageIndex);
+}
+
+/*!
+ * Returns the solar azimuth of the image with the specified index \p imageIndex, without
+ * creating a KDynamicWallpaperMetaData object.
+ *
+ * This method will return \c 0 if the provided index is outside the valid range.
+ */
+qreal DynamicWallpaperDescription::solarAzimuthAt(int imageIndex) const
+{
+    return m_solarAzimuths.value(imageIndex);
+}
+
+/*!
+ * Returns the cross-fade mode of the image with the specified index \p imageIndex, without
+ * creating a KDynamicWallpaperMetaData object.
+ *
+ * This method will return KDynamicWallpaperMetaData::NoCrossFade if the provided index is
+ * outside the valid range.
+ */
+KDynamicWallpaperMetaData::CrossFadeMode DynamicWallpaperDescription::crossFadeModeAt(int imageIndex) const
+{
+    return m_crossFadeModes.value(imageIndex, KDynamicWallpaperMetaData::NoCrossFade);
+}
+
+/*!
+ * Returns the metadata of all images in the dynamic wallpaper.
+ */
+KDynamicWallpaperMetaDataTable DynamicWallpaperDescription::metaDataTable() const
+{
+    return m_metaData;
 }
 
 /*!
@@ -78,32 +141,39 @@ KDynamicWallpaperMetaData DynamicWallpaperDescription::metaDataAt(int imageIndex
  */
 DynamicWallpaperDescription DynamicWallpaperDescription::fromFile(const QString &fileName)
 {
-    KDynamicWallpaperReader reader(fileName);
-    if (reader.error() != KDynamicWallpaperReader::NoError)
+    const KDynamicWallpaperInfo info(fileName);
+    if (info.error() != KDynamicWallpaperInfo::NoError)
         return DynamicWallpaperDescription();
 
-    DynamicWallpaperDescription description;
-
-    const QList<KDynamicWallpaperMetaData> metaDataList = reader.metaData();
-    for (const KDynamicWallpaperMetaData &metaData : metaDataList) {
-        if (!metaData.isValid())
-            return DynamicWallpaperDescription();
-
-        DynamicWallpaperImageHandle handle;
-        handle.setFileName(fileName);
-        handle.setImageIndex(metaData.index());
-
-        description.addImage(handle.toUrl(), metaData);
-    }
-
-    return description;
+    return fromMetaData(fileName, info.metaDataTable());
 }
 
 /*!
- * \internal
+ * Returns the DynamicWallpaperDescription for the images with the given \p metaData in the
+ * file \p fileName. The file is not read.
+ *
+ * The returned description will be invalid if \p metaData is empty.
  */
-void DynamicWallpaperDescription::addImage(const QUrl &url, const KDynamicWallpaperMetaData &metaData)
+DynamicWallpaperDescription DynamicWallpaperDescription::fromMetaData(const QString &fileName,
+                                                                      const KDynamicWallpaperMetaDataTable &metaData)
 {
-    m_imageUrls << url;
-    m_metaData << metaData;
+    // The table holds only valid metadata, so there's nothing else to check.
+    DynamicWallpaperDescription description;
+    description.m_fileName = fileName;
+    description.m_metaData = metaData;
+
+    // The columns are shared with the table, keep them at hand for the engines.
+    description.m_times = description.m_metaData.times();
+    description.m_solarElevations = description.m_metaData.solarElevations();
+    description.m_solarAzimuths = description.m_metaData.solarAzimuths();
+    description.m_crossFadeModes = description.m_metaData.crossFadeModes();
+    description.m_imageIndices = description.m_metaData.indices();
+
+    // Exclude the solar engine if there's at least one image without solar metadata. This
+    // scans every image, so it's done once rather than whenever an engine is created.
+    description.m_supportedEngines = SolarEngine | TimedEngine;
+    if (!(metaData.commonFields() & KDynamicWallpaperMetaData::SolarAzimuthField))
+        description.m_supportedEngines &= ~SolarEngine;
+
+    return description;
 }
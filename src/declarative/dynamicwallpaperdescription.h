@@ -7,6 +7,7 @@
 #pragma once
 
 #include <KDynamicWallpaperMetaData>
+#include <KDynamicWallpaperMetaDataTable>
 
 #include <QString>
 #include <QUrl>
@@ -31,13 +32,26 @@ public:
     QUrl imageUrlAt(int imageIndex) const;
     KDynamicWallpaperMetaData metaDataAt(int imageIndex) const;
 
+    qreal timeAt(int imageIndex) const;
+    qreal solarElevationAt(int imageIndex) const;
+    qreal solarAzimuthAt(int imageIndex) const;
+    KDynamicWallpaperMetaData::CrossFadeMode crossFadeModeAt(int imageIndex) const;
+
+    KDynamicWallpaperMetaDataTable metaDataTable() const;
+
     static DynamicWallpaperDescription fromFile(const QString &fileName);
+    static DynamicWallpaperDescription fromMetaData(const QString &fileName,
+                                                    const KDynamicWallpaperMetaDataTable &metaData);
 
 private:
-    void addImage(const QUrl &url, const KDynamicWallpaperMetaData &metaData);
-
-    QVector<KDynamicWallpaperMetaData> m_metaData;
-    QVector<QUrl> m_imageUrls;
+    QString m_fileName;
+    KDynamicWallpaperMetaDataTable m_metaData;
+    QVector<qreal> m_times;
+    QVector<qreal> m_solarElevations;
+    QVector<qreal> m_solarAzimuths;
+    QVector<KDynamicWallpaperMetaData::CrossFadeMode> m_crossFadeModes;
+    QVector<int> m_imageIndices;
+    EngineTypes m_supportedEngines;
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(DynamicWallpaperDescription::EngineTypes)
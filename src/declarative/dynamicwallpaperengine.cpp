@@ -5,6 +5,13 @@
  */
 
 #include "dynamicwallpaperengine.h"
+#include "dynamicwallpaperengine_solar.h"
+#include "dynamicwallpaperengine_timed.h"
+
+#include <QScopedPointer>
+
+#include <algorithm>
+#include <cmath>
 
 /*!
  * Destructs the DynamicWallpaperEngine object.
@@ -20,13 +27,22 @@ DynamicWallpaperEngine::~DynamicWallpaperEngine()
  */
 void DynamicWallpaperEngine::setDescription(const DynamicWallpaperDescription &description)
 {
-    m_progressToImageIndex.clear();
     m_description = description;
 
-    for (int i = 0; i < m_description.imageCount(); ++i) {
-        const KDynamicWallpaperMetaData metaData = m_description.metaDataAt(i);
-        m_progressToImageIndex.insert(progressForMetaData(metaData), i);
-    }
+    m_keyframes.clear();
+    m_keyframes.reserve(m_description.imageCount());
+    for (int i = 0; i < m_description.imageCount(); ++i)
+        m_keyframes.append({ progressForImage(m_description, i), i });
+
+    // The keyframes are sorted once so update() can find the current one with a binary search.
+    // If several images share the same progress, the last one wins.
+    std::stable_sort(m_keyframes.begin(), m_keyframes.end(), [](const Keyframe &a, const Keyframe &b) {
+        return a.progress < b.progress;
+    });
+    auto last = std::unique(m_keyframes.rbegin(), m_keyframes.rend(), [](const Keyframe &a, const Keyframe &b) {
+        return a.progress == b.progress;
+    });
+    m_keyframes.erase(m_keyframes.begin(), last.base());
 }
 
 /*!
@@ -38,13 +54,74 @@ DynamicWallpaperDescription DynamicWallpaperEngine::description() const
 }
 
 /*!
- * Returns \c true if the engine has been expired and must be rebuilt; otherwise returns \c false.
+ * Returns \c true if the engine has been expired at the specified \p dateTime and must be
+ * rebuilt; otherwise returns \c false.
  */
-bool DynamicWallpaperEngine::isExpired() const
+bool DynamicWallpaperEngine::isExpired(const QDateTime &dateTime) const
 {
+    Q_UNUSED(dateTime)
     return false;
 }
 
+/*!
+ * Creates the most suitable engine for the wallpaper with the specified \p description at
+ * the given \p location and \p dateTime. The solar engine is preferred if the wallpaper
+ * supports it and the position of the Sun can be determined; otherwise the timed engine is
+ * used.
+ *
+ * Returns \c nullptr if the description is not valid.
+ */
+DynamicWallpaperEngine *DynamicWallpaperEngine::create(const DynamicWallpaperDescription &description,
+                                                       const QGeoCoordinate &location,
+                                                       const QDateTime &dateTime)
+{
+    if (!description.isValid())
+        return nullptr;
+
+    DynamicWallpaperEngine *engine = nullptr;
+    if (description.supportedEngines() & DynamicWallpaperDescription::SolarEngine)
+        engine = SolarDynamicWallpaperEngine::create(location, dateTime);
+    if (!engine)
+        engine = TimedDynamicWallpaperEngine::create();
+
+    engine->setDescription(description);
+    return engine;
+}
+
+/*!
+ * Simulates the wallpaper with the specified \p description at the given \p location from
+ * \p from to \p to, with a time step of \p step seconds, and returns what is displayed at
+ * every step. The engine is rebuilt whenever it expires, exactly like the wallpaper does.
+ *
+ * This can be used to check a wallpaper over a long period of time, e.g. a year, without
+ * waiting for the wall clock.
+ */
+QVector<DynamicWallpaperEngine::TimelineEntry> DynamicWallpaperEngine::evaluate(const DynamicWallpaperDescription &description,
+                                                                                const QGeoCoordinate &location,
+                                                                                const QDateTime &from,
+                                                                                const QDateTime &to,
+                                                                                qint64 step)
+{
+    QVector<TimelineEntry> timeline;
+    if (step <= 0 || from > to)
+        return timeline;
+
+    QScopedPointer<DynamicWallpaperEngine> engine;
+    timeline.reserve(from.secsTo(to) / step + 1);
+
+    for (QDateTime dateTime = from; dateTime <= to; dateTime = dateTime.addSecs(step)) {
+        if (!engine || engine->isExpired(dateTime))
+            engine.reset(create(description, location, dateTime));
+        if (!engine)
+            break;
+
+        engine->update(dateTime);
+        timeline.append({ dateTime, engine->bottomLayer(), engine->topLayer(), engine->blendFactor() });
+    }
+
+    return timeline;
+}
+
 /*!
  * Returns the QUrl of the image that is currently being displayed in the top layer.
  */
@@ -69,6 +146,10 @@ qreal DynamicWallpaperEngine::blendFactor() const
     return m_blendFactor;
 }
 
+// Scanning the day at this rate only misses a change if the frame changes and goes back to the
+// current one within a single step. The solar progress is tabulated at the same rate.
+static const qint64 s_scanStep = 60;
+
 static qreal computeTimeSpan(qreal from, qreal to)
 {
     if (to < from)
@@ -104,32 +185,99 @@ static qreal computeBlendFactor(qreal from, qreal to, qreal now)
 }
 
 /*!
- * Updates the internal state of the DynamicWallpaperEngine.
+ * \internal
+ *
+ * Returns the images and the blend factor that are displayed at the specified \p progress.
+ * The top image is -1 if the images are not cross-faded.
  */
-void DynamicWallpaperEngine::update()
+DynamicWallpaperEngine::Frame DynamicWallpaperEngine::frameForProgress(qreal progress) const
 {
-    const qreal progress = progressForDateTime(QDateTime::currentDateTime());
-
-    QMap<qreal, int>::iterator nextImage;
-    QMap<qreal, int>::iterator currentImage;
+    QVector<Keyframe>::const_iterator nextImage;
+    QVector<Keyframe>::const_iterator currentImage;
 
-    nextImage = m_progressToImageIndex.upperBound(progress);
-    if (nextImage == m_progressToImageIndex.end())
-        nextImage = m_progressToImageIndex.begin();
+    nextImage = std::upper_bound(m_keyframes.constBegin(), m_keyframes.constEnd(), progress,
+                                 [](qreal progress, const Keyframe &keyframe) {
+                                     return progress < keyframe.progress;
+                                 });
+    if (nextImage == m_keyframes.constEnd())
+        nextImage = m_keyframes.constBegin();
 
-    if (nextImage == m_progressToImageIndex.begin())
-        currentImage = std::prev(m_progressToImageIndex.end());
+    if (nextImage == m_keyframes.constBegin())
+        currentImage = std::prev(m_keyframes.constEnd());
     else
         currentImage = std::prev(nextImage);
 
-    const KDynamicWallpaperMetaData currentMetaData = description().metaDataAt(*currentImage);
-    if (currentMetaData.crossFadeMode() == KDynamicWallpaperMetaData::CrossFade) {
-        m_topLayer = description().imageUrlAt(*nextImage);
-        m_blendFactor = computeBlendFactor(currentImage.key(), nextImage.key(), progress);
-    } else {
-        m_topLayer = QUrl();
-        m_blendFactor = 0;
+    if (m_description.crossFadeModeAt(currentImage->imageIndex) == KDynamicWallpaperMetaData::CrossFade)
+        return { currentImage->imageIndex, nextImage->imageIndex,
+                 computeBlendFactor(currentImage->progress, nextImage->progress, progress) };
+
+    return { currentImage->imageIndex, -1, 0 };
+}
+
+/*!
+ * \internal
+ *
+ * Returns the earliest time after \p dateTime, with a precision of one second, at which the
+ * displayed \p frame changes by a visible amount, or the next midnight if the frame doesn't
+ * change before then. The engine may expire at midnight, so the search never goes past it.
+ *
+ * The progress wraps around once a day, e.g. at the solar midnight, so the current frame may
+ * come back later in the day and a binary search over the whole day could skip keyframes.
+ * Instead, the day is scanned in coarse steps until the frame changes, and the change is then
+ * narrowed down with a binary search.
+ */
+QDateTime DynamicWallpaperEngine::findNextUpdate(const QDateTime &dateTime, const Frame &frame) const
+{
+    // The blend factor ends up in an 8-bit color channel, smaller changes can't be seen.
+    auto isVisiblyDifferent = [&](qint64 offset) {
+        const Frame candidate = frameForProgress(progressForDateTime(dateTime.addSecs(offset)));
+        return frame.bottomImage != candidate.bottomImage || frame.topImage != candidate.topImage ||
+            std::abs(frame.blendFactor - candidate.blendFactor) >= 1.0 / 255;
+    };
+
+    const QDateTime midnight(dateTime.date().addDays(1), QTime(0, 0));
+    const qint64 lastSecond = dateTime.secsTo(midnight) - 1;
+
+    qint64 low = 0;
+    qint64 high = 0;
+    do {
+        if (low >= lastSecond)
+            return midnight;
+        high = std::min(low + s_scanStep, lastSecond);
+        if (!isVisiblyDifferent(high))
+            low = high;
+    } while (low == high);
+
+    while (high - low > 1) {
+        const qint64 middle = low + (high - low) / 2;
+        if (isVisiblyDifferent(middle))
+            high = middle;
+        else
+            low = middle;
     }
 
-    m_bottomLayer = description().imageUrlAt(*currentImage);
+    return dateTime.addSecs(high);
+}
+
+/*!
+ * Updates the internal state of the DynamicWallpaperEngine to match the specified \p dateTime.
+ */
+void DynamicWallpaperEngine::update(const QDateTime &dateTime)
+{
+    const Frame frame = frameForProgress(progressForDateTime(dateTime));
+
+    m_bottomLayer = m_description.imageUrlAt(frame.bottomImage);
+    m_topLayer = frame.topImage == -1 ? QUrl() : m_description.imageUrlAt(frame.topImage);
+    m_blendFactor = frame.blendFactor;
+    m_nextUpdateDateTime = findNextUpdate(dateTime, frame);
+}
+
+/*!
+ * Returns the time at which the wallpaper changes by a visible amount next, i.e. either the
+ * displayed images change or the blend factor changes enough to be noticed. The result is
+ * only valid after update() has been called.
+ */
+QDateTime DynamicWallpaperEngine::nextUpdateDateTime() const
+{
+    return m_nextUpdateDateTime;
 }
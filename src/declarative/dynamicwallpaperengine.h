@@ -9,32 +9,65 @@
 #include "dynamicwallpaperdescription.h"
 
 #include <QDateTime>
-#include <QMap>
+#include <QGeoCoordinate>
+#include <QVector>
 
 class DynamicWallpaperEngine
 {
 public:
+    struct TimelineEntry
+    {
+        QDateTime dateTime;
+        QUrl bottomLayer;
+        QUrl topLayer;
+        qreal blendFactor;
+    };
+
     virtual ~DynamicWallpaperEngine();
 
     void setDescription(const DynamicWallpaperDescription &description);
     DynamicWallpaperDescription description() const;
 
-    void update();
+    void update(const QDateTime &dateTime);
 
     QUrl bottomLayer() const;
     QUrl topLayer() const;
     qreal blendFactor() const;
+    QDateTime nextUpdateDateTime() const;
+
+    virtual bool isExpired(const QDateTime &dateTime) const;
 
-    virtual bool isExpired() const;
+    static DynamicWallpaperEngine *create(const DynamicWallpaperDescription &description,
+                                          const QGeoCoordinate &location, const QDateTime &dateTime);
+    static QVector<TimelineEntry> evaluate(const DynamicWallpaperDescription &description,
+                                           const QGeoCoordinate &location, const QDateTime &from,
+                                           const QDateTime &to, qint64 step);
 
 protected:
-    virtual qreal progressForMetaData(const KDynamicWallpaperMetaData &metaData) const = 0;
+    virtual qreal progressForImage(const DynamicWallpaperDescription &description, int imageIndex) const = 0;
     virtual qreal progressForDateTime(const QDateTime &dateTime) const = 0;
 
 private:
+    struct Keyframe
+    {
+        qreal progress;
+        int imageIndex;
+    };
+
+    struct Frame
+    {
+        int bottomImage;
+        int topImage;
+        qreal blendFactor;
+    };
+
+    Frame frameForProgress(qreal progress) const;
+    QDateTime findNextUpdate(const QDateTime &dateTime, const Frame &frame) const;
+
     DynamicWallpaperDescription m_description;
-    QMap<qreal, int> m_progressToImageIndex;
+    QVector<Keyframe> m_keyframes;
     QUrl m_topLayer;
     QUrl m_bottomLayer;
     qreal m_blendFactor;
+    QDateTime m_nextUpdateDateTime;
 };
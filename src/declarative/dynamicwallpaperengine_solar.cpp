@@ -8,26 +8,53 @@
 
 #include <cmath>
 
+// The progress is tabulated once a minute over 25 hours starting at the local midnight, which
+// covers days that are stretched by a daylight saving time transition. Between two samples,
+// the progress is interpolated linearly, so the error is at most the distance the Sun travels
+// in a minute, i.e. about 1/1440.
+static const int s_tableStep = 60;
+static const int s_tableSize = 25 * 60 + 1;
+
 SolarDynamicWallpaperEngine::SolarDynamicWallpaperEngine(const KSunPath &sunPath,
                                                          const KSunPosition &midnight,
                                                          const QGeoCoordinate &location,
                                                          const QDateTime &dateTime)
     : m_sunPath(sunPath)
-    , m_midnight(midnight)
+    , m_midnightDirection((sunPath.project(midnight) - sunPath.center()).normalized())
     , m_location(location)
     , m_dateTime(dateTime)
+    , m_tableStart(QDateTime(dateTime.date(), QTime(0, 0)).toSecsSinceEpoch())
 {
+    buildProgressTable();
 }
 
-bool SolarDynamicWallpaperEngine::isExpired() const
+void SolarDynamicWallpaperEngine::buildProgressTable()
 {
-    return m_dateTime.date() != QDate::currentDate();
+    QVector<qint64> times(s_tableSize);
+    for (int i = 0; i < s_tableSize; ++i)
+        times[i] = m_tableStart + qint64(i) * s_tableStep;
+
+    const QVector<KSunPosition> positions = KSunPosition::compute(times, m_location);
+
+    // The progress wraps around at the solar midnight, which is usually not the local midnight.
+    // Unwrap it so that the neighbouring samples can be interpolated.
+    m_progressTable.resize(s_tableSize);
+    qreal turns = 0;
+    for (int i = 0; i < s_tableSize; ++i) {
+        const qreal progress = progressForPosition(positions[i]);
+        if (i > 0 && progress + turns < m_progressTable[i - 1] - 0.5)
+            turns += 1;
+        m_progressTable[i] = progress + turns;
+    }
 }
 
-SolarDynamicWallpaperEngine *SolarDynamicWallpaperEngine::create(const QGeoCoordinate &location)
+bool SolarDynamicWallpaperEngine::isExpired(const QDateTime &dateTime) const
 {
-    const QDateTime dateTime = QDateTime::currentDateTime();
+    return m_dateTime.date() != dateTime.date();
+}
 
+SolarDynamicWallpaperEngine *SolarDynamicWallpaperEngine::create(const QGeoCoordinate &location, const QDateTime &dateTime)
+{
     const KSunPosition midnight = KSunPosition::midnight(dateTime, location);
     if (!midnight.isValid())
         return nullptr;
@@ -39,24 +66,32 @@ SolarDynamicWallpaperEngine *SolarDynamicWallpaperEngine::create(const QGeoCoord
     return new SolarDynamicWallpaperEngine(path, midnight, location, dateTime);
 }
 
-qreal SolarDynamicWallpaperEngine::progressForMetaData(const KDynamicWallpaperMetaData &metaData) const
+qreal SolarDynamicWallpaperEngine::progressForImage(const DynamicWallpaperDescription &description, int imageIndex) const
 {
-    const KSunPosition position(metaData.solarElevation(), metaData.solarAzimuth());
+    const KSunPosition position(description.solarElevationAt(imageIndex), description.solarAzimuthAt(imageIndex));
     return progressForPosition(position);
 }
 
 qreal SolarDynamicWallpaperEngine::progressForDateTime(const QDateTime &dateTime) const
 {
-    const KSunPosition position(dateTime, m_location);
-    return progressForPosition(position);
+    const qreal offset = (dateTime.toMSecsSinceEpoch() - m_tableStart * 1000) / (1000.0 * s_tableStep);
+    const int index = std::floor(offset);
+    if (index < 0 || index + 1 >= m_progressTable.count()) {
+        const KSunPosition position(dateTime, m_location);
+        return progressForPosition(position);
+    }
+
+    const qreal from = m_progressTable[index];
+    const qreal to = m_progressTable[index + 1];
+    const qreal progress = from + (to - from) * (offset - index);
+    return progress - std::floor(progress);
 }
 
 qreal SolarDynamicWallpaperEngine::progressForPosition(const KSunPosition &position) const
 {
-    const QVector3D projectedMidnight = m_sunPath.project(m_midnight);
     const QVector3D projectedPosition = m_sunPath.project(position);
 
-    const QVector3D v1 = (projectedMidnight - m_sunPath.center()).normalized();
+    const QVector3D v1 = m_midnightDirection;
     const QVector3D v2 = (projectedPosition - m_sunPath.center()).normalized();
 
     const QVector3D cross = QVector3D::crossProduct(v1, v2);
@@ -14,21 +14,24 @@
 class SolarDynamicWallpaperEngine : public DynamicWallpaperEngine
 {
 public:
-    bool isExpired() const override;
+    bool isExpired(const QDateTime &dateTime) const override;
 
-    static SolarDynamicWallpaperEngine *create(const QGeoCoordinate &location);
+    static SolarDynamicWallpaperEngine *create(const QGeoCoordinate &location, const QDateTime &dateTime);
 
 protected:
-    qreal progressForMetaData(const KDynamicWallpaperMetaData &metaData) const override;
+    qreal progressForImage(const DynamicWallpaperDescription &description, int imageIndex) const override;
     qreal progressForDateTime(const QDateTime &dateTime) const override;
 
 private:
     SolarDynamicWallpaperEngine(const KSunPath &sunPath, const KSunPosition &midnight,
                                 const QGeoCoordinate &location, const QDateTime &dateTime);
     qreal progressForPosition(const KSunPosition &position) const;
+    void buildProgressTable();
 
     KSunPath m_sunPath;
-    KSunPosition m_midnight;
+    QVector3D m_midnightDirection;
     QGeoCoordinate m_location;
     QDateTime m_dateTime;
+    qint64 m_tableStart;
+    QVector<qreal> m_progressTable;
 };
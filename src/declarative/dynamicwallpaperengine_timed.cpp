@@ -11,9 +11,9 @@ TimedDynamicWallpaperEngine *TimedDynamicWallpaperEngine::create()
     return new TimedDynamicWallpaperEngine();
 }
 
-qreal TimedDynamicWallpaperEngine::progressForMetaData(const KDynamicWallpaperMetaData &metaData) const
+qreal TimedDynamicWallpaperEngine::progressForImage(const DynamicWallpaperDescription &description, int imageIndex) const
 {
-    return metaData.time();
+    return description.timeAt(imageIndex);
 }
 
 qreal TimedDynamicWallpaperEngine::progressForDateTime(const QDateTime &dateTime) const
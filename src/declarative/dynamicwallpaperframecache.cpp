@@ -0,0 +1,165 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "dynamicwallpaperframecache.h"
+
+#include <QHash>
+
+/*!
+ * \class DynamicWallpaperFrameCache
+ * \brief The DynamicWallpaperFrameCache class caches decoded wallpaper frames in memory.
+ *
+ * Frames are keyed by the file name, the image index, the requested size and whether the frame
+ * has been cropped to the aspect ratio of the requested size. The cost of a
+ * frame is the number of bytes it occupies; when the byte budget is exceeded, the least
+ * recently used frames are evicted. This allows to serve a frame that has just been on the
+ * screen, e.g. when the top and the bottom layer are flipped, without decoding it again.
+ *
+ * The byte budget is 128 MiB by default. It can be changed with the
+ * PLASMA_DYNAMIC_WALLPAPER_FRAME_CACHE_SIZE environment variable, which specifies the budget
+ * in mebibytes; 0 disables the cache.
+ *
+ * All methods of DynamicWallpaperFrameCache can be called from multiple threads simultaneously.
+ */
+
+// QCache measures costs with an int, so frames are accounted in kibibytes.
+static const int s_costUnit = 1024;
+static const qint64 s_defaultMaxBytes = 128 * 1024 * 1024;
+
+/*!
+ * Constructs a key for the frame with the specified \a imageIndex in the file \a fileName.
+ * \a lastModified is the modification time of the file, in milliseconds since the epoch, so
+ * frames of a wallpaper that has been modified on disk are not served. It's up to the caller
+ * to determine it, preferably not on the GUI thread.
+ */
+DynamicWallpaperFrameCacheKey::DynamicWallpaperFrameCacheKey(const QString &fileName, qint64 lastModified, int imageIndex,
+                                                             const QSize &size, bool isCropped)
+    : fileName(fileName)
+    , lastModified(lastModified)
+    , imageIndex(imageIndex)
+    , size(size)
+    , isCropped(isCropped)
+{
+}
+
+bool DynamicWallpaperFrameCacheKey::operator==(const DynamicWallpaperFrameCacheKey &other) const
+{
+    return fileName == other.fileName && lastModified == other.lastModified &&
+            imageIndex == other.imageIndex && size == other.size && isCropped == other.isCropped;
+}
+
+uint qHash(const DynamicWallpaperFrameCacheKey &key, uint seed)
+{
+    seed = qHash(key.fileName, seed);
+    seed = qHash(key.lastModified, seed);
+    seed = qHash(key.imageIndex, seed);
+    seed = qHash(key.size.width(), seed);
+    seed = qHash(key.size.height(), seed);
+    return qHash(key.isCropped, seed);
+}
+
+Q_GLOBAL_STATIC(DynamicWallpaperFrameCache, s_frameCache)
+
+/*!
+ * Returns the frame cache shared by all image providers in the process.
+ */
+DynamicWallpaperFrameCache *DynamicWallpaperFrameCache::instance()
+{
+    return s_frameCache;
+}
+
+DynamicWallpaperFrameCache::DynamicWallpaperFrameCache()
+{
+    bool ok = false;
+    const int megabytes = qEnvironmentVariableIntValue("PLASMA_DYNAMIC_WALLPAPER_FRAME_CACHE_SIZE", &ok);
+    setMaxBytes(ok && megabytes >= 0 ? qint64(megabytes) * 1024 * 1024 : s_defaultMaxBytes);
+}
+
+/*!
+ * Returns the cached frame for the specified \a key, or a null QImage if there is none.
+ */
+QImage DynamicWallpaperFrameCache::load(const DynamicWallpaperFrameCacheKey &key)
+{
+    QMutexLocker locker(&m_mutex);
+
+    const QImage *image = m_images.object(key);
+    if (!image) {
+        m_missCount++;
+        return QImage();
+    }
+
+    m_hitCount++;
+    return *image;
+}
+
+/*!
+ * Stores the \a image for the specified \a key in the cache. Images larger than the byte
+ * budget are not cached.
+ */
+void DynamicWallpaperFrameCache::store(const DynamicWallpaperFrameCacheKey &key, const QImage &image)
+{
+    if (image.isNull())
+        return;
+
+    const int cost = int((image.sizeInBytes() + s_costUnit - 1) / s_costUnit);
+
+    QMutexLocker locker(&m_mutex);
+    m_images.insert(key, new QImage(image), cost);
+}
+
+/*!
+ * Removes all frames from the cache.
+ */
+void DynamicWallpaperFrameCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_images.clear();
+}
+
+/*!
+ * Sets the byte budget of the cache to \a bytes. Frames are evicted if necessary.
+ */
+void DynamicWallpaperFrameCache::setMaxBytes(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_images.setMaxCost(int(bytes / s_costUnit));
+}
+
+/*!
+ * Returns the byte budget of the cache.
+ */
+qint64 DynamicWallpaperFrameCache::maxBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return qint64(m_images.maxCost()) * s_costUnit;
+}
+
+/*!
+ * Returns the number of bytes occupied by the cached frames.
+ */
+qint64 DynamicWallpaperFrameCache::totalBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return qint64(m_images.totalCost()) * s_costUnit;
+}
+
+/*!
+ * Returns the number of lookups that have been served from the cache.
+ */
+int DynamicWallpaperFrameCache::hitCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_hitCount;
+}
+
+/*!
+ * Returns the number of lookups that have not been served from the cache.
+ */
+int DynamicWallpaperFrameCache::missCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_missCount;
+}
@@ -0,0 +1,54 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+
+class DynamicWallpaperFrameCacheKey
+{
+public:
+    DynamicWallpaperFrameCacheKey() = default;
+    DynamicWallpaperFrameCacheKey(const QString &fileName, qint64 lastModified, int imageIndex,
+                                  const QSize &size, bool isCropped);
+
+    bool operator==(const DynamicWallpaperFrameCacheKey &other) const;
+
+    QString fileName;
+    qint64 lastModified = 0;
+    int imageIndex = -1;
+    QSize size;
+    bool isCropped = false;
+};
+
+uint qHash(const DynamicWallpaperFrameCacheKey &key, uint seed = 0);
+
+class DynamicWallpaperFrameCache
+{
+public:
+    static DynamicWallpaperFrameCache *instance();
+
+    DynamicWallpaperFrameCache();
+
+    QImage load(const DynamicWallpaperFrameCacheKey &key);
+    void store(const DynamicWallpaperFrameCacheKey &key, const QImage &image);
+    void clear();
+
+    void setMaxBytes(qint64 bytes);
+    qint64 maxBytes() const;
+    qint64 totalBytes() const;
+
+    int hitCount() const;
+    int missCount() const;
+
+private:
+    mutable QMutex m_mutex;
+    QCache<DynamicWallpaperFrameCacheKey, QImage> m_images;
+    int m_hitCount = 0;
+    int m_missCount = 0;
+};
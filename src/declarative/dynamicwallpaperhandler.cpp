@@ -8,21 +8,33 @@
 
 #include "dynamicwallpaperhandler.h"
 #include "dynamicwallpaperdescription.h"
-#include "dynamicwallpaperengine_solar.h"
-#include "dynamicwallpaperengine_timed.h"
+#include "dynamicwallpaperengine.h"
 
 #include <KConfigGroup>
 #include <KLocalizedString>
 #include <KPackage/PackageLoader>
 #include <KSharedConfig>
 
+// The wallpaper is updated at least this often, in milliseconds, to recover from clock jumps
+// and time zone changes that went unnoticed. That is 48 wakeups a day when nothing changes.
+static const int s_maxUpdateDelay = 30 * 60 * 1000;
+
 DynamicWallpaperHandler::DynamicWallpaperHandler(QObject *parent)
     : QObject(parent)
     , m_updateTimer(new QTimer(this))
+    , m_nextUpdateTimer(new QTimer(this))
 {
     m_updateTimer->setInterval(0);
     m_updateTimer->setSingleShot(true);
     connect(m_updateTimer, &QTimer::timeout, this, &DynamicWallpaperHandler::update);
+
+    // The timer is re-armed after every update for the moment the wallpaper changes next. If
+    // the system clock jumps, e.g. after resuming from suspend, the owner should call
+    // scheduleUpdate() so the timer is re-armed for the new time. Clock jumps can't be detected
+    // on every platform and time zone changes aren't detected at all, so the delay is capped.
+    m_nextUpdateTimer->setSingleShot(true);
+    m_nextUpdateTimer->setTimerType(Qt::VeryCoarseTimer);
+    connect(m_nextUpdateTimer, &QTimer::timeout, this, &DynamicWallpaperHandler::scheduleUpdate);
 }
 
 DynamicWallpaperHandler::~DynamicWallpaperHandler()
@@ -35,7 +47,7 @@ void DynamicWallpaperHandler::setLocation(const QGeoCoordinate &coordinate)
     if (m_location == coordinate)
         return;
     m_location = coordinate;
-    reloadEngine();
+    reloadEngine(QDateTime::currentDateTime());
     scheduleUpdate();
     emit locationChanged();
 }
@@ -106,7 +118,7 @@ void DynamicWallpaperHandler::setSource(const QUrl &url)
         return;
     m_source = source;
     reloadDescription();
-    reloadEngine();
+    reloadEngine(QDateTime::currentDateTime());
     scheduleUpdate();
     emit sourceChanged();
 }
@@ -190,12 +202,16 @@ void DynamicWallpaperHandler::update()
 {
     if (m_status != Ready)
         return;
-    if (!m_engine || m_engine->isExpired())
-        reloadEngine();
-    m_engine->update();
+    const QDateTime dateTime = QDateTime::currentDateTime();
+    if (!m_engine || m_engine->isExpired(dateTime))
+        reloadEngine(dateTime);
+    m_engine->update(dateTime);
     setTopLayer(m_engine->topLayer());
     setBottomLayer(m_engine->bottomLayer());
     setBlendFactor(m_engine->blendFactor());
+
+    const qint64 delay = dateTime.msecsTo(m_engine->nextUpdateDateTime());
+    m_nextUpdateTimer->start(int(qBound<qint64>(0, delay, s_maxUpdateDelay)));
 }
 
 void DynamicWallpaperHandler::reloadDescription()
@@ -212,18 +228,8 @@ void DynamicWallpaperHandler::reloadDescription()
     }
 }
 
-void DynamicWallpaperHandler::reloadEngine()
+void DynamicWallpaperHandler::reloadEngine(const QDateTime &dateTime)
 {
     delete m_engine;
-    m_engine = nullptr;
-
-    if (!m_description.isValid())
-        return;
-
-    if (m_description.supportedEngines() & DynamicWallpaperDescription::SolarEngine)
-        m_engine = SolarDynamicWallpaperEngine::create(m_location);
-    if (!m_engine)
-        m_engine = TimedDynamicWallpaperEngine::create();
-
-    m_engine->setDescription(m_description);
+    m_engine = DynamicWallpaperEngine::create(m_description, m_location, dateTime);
 }
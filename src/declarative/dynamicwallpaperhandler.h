@@ -68,11 +68,12 @@ Q_SIGNALS:
 
 private:
     void reloadDescription();
-    void reloadEngine();
+    void reloadEngine(const QDateTime &dateTime);
 
     DynamicWallpaperDescription m_description;
     DynamicWallpaperEngine *m_engine = nullptr;
     QTimer *m_updateTimer;
+    QTimer *m_nextUpdateTimer;
     QGeoCoordinate m_location;
     QString m_errorString;
     QUrl m_source;
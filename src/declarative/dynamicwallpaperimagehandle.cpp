@@ -13,6 +13,7 @@
  */
 DynamicWallpaperImageHandle::DynamicWallpaperImageHandle()
     : m_imageIndex(-1)
+    , m_isCropped(false)
 {
 }
 
@@ -56,6 +57,26 @@ int DynamicWallpaperImageHandle::imageIndex() const
     return m_imageIndex;
 }
 
+/*!
+ * Sets whether the image should be cropped to the aspect ratio of the requested size.
+ *
+ * Cropped images are only decoded and converted inside the area that remains visible with the
+ * Image.PreserveAspectCrop fill mode.
+ */
+void DynamicWallpaperImageHandle::setCropped(bool cropped)
+{
+    m_isCropped = cropped;
+}
+
+/*!
+ * Returns \c true if the image should be cropped to the aspect ratio of the requested size;
+ * otherwise returns \c false.
+ */
+bool DynamicWallpaperImageHandle::isCropped() const
+{
+    return m_isCropped;
+}
+
 static QString fileNameFromBase64(const QStringRef &base64)
 {
     return QByteArray::fromBase64(base64.toUtf8());
@@ -87,6 +108,8 @@ QString DynamicWallpaperImageHandle::toString() const
 {
     const QString fileName = base64FromFileName(m_fileName);
     const QString imageIndex = stringFromImageIndex(m_imageIndex);
+    if (m_isCropped)
+        return fileName + '#' + imageIndex + QLatin1String("#crop");
     return fileName + '#' + imageIndex;
 }
 
@@ -110,7 +133,7 @@ DynamicWallpaperImageHandle DynamicWallpaperImageHandle::fromString(const QStrin
 #else
     const QVector<QStringRef> parts = string.splitRef('#', QString::SkipEmptyParts);
 #endif
-    if (parts.count() != 2)
+    if (parts.count() != 2 && parts.count() != 3)
         return handle;
 
     // Encoding and decoding a file name to/from base64 is definitely an overkill, but I don't
@@ -118,6 +141,8 @@ DynamicWallpaperImageHandle DynamicWallpaperImageHandle::fromString(const QStrin
 
     handle.setFileName(fileNameFromBase64(parts[0]));
     handle.setImageIndex(imageIndexFromString(parts[1]));
+    if (parts.count() == 3)
+        handle.setCropped(parts[2] == QLatin1String("crop"));
 
     return handle;
 }
@@ -22,6 +22,9 @@ public:
     void setImageIndex(int index);
     int imageIndex() const;
 
+    void setCropped(bool cropped);
+    bool isCropped() const;
+
     QString toString() const;
     QUrl toUrl() const;
 
@@ -30,4 +33,5 @@ public:
 private:
     QString m_fileName;
     int m_imageIndex;
+    bool m_isCropped;
 };
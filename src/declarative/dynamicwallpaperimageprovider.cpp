@@ -5,69 +5,152 @@
  */
 
 #include "dynamicwallpaperimageprovider.h"
-#include "dynamicwallpaperglobals.h"
+#include "dynamicwallpaperframecache.h"
 #include "dynamicwallpaperimagehandle.h"
 
 #include <KDynamicWallpaperReader>
+#include <KDynamicWallpaperReaderPool>
 
-#include <QtConcurrent>
+#include <QFileInfo>
 #include <QFutureWatcher>
+#include <QtConcurrent>
 
-static DynamicWallpaperImageAsyncResult load(const QString &fileName, int index, const QSize &requestedSize)
+class DynamicWallpaperFrameLookup
 {
-    const KDynamicWallpaperReader reader(fileName);
-    if (reader.error() != KDynamicWallpaperReader::NoError)
-        return DynamicWallpaperImageAsyncResult(reader.errorString());
-
-    // If the requested image size is valid, scale the image without preserving the
-    // aspect ratio.
-    QImage image = reader.image(index);
-    if (requestedSize.isValid())
-        image = image.scaled(requestedSize);
-
-    // QtQuick wants images to have the format of ARGB32_Premultiplied, so perform
-    // format conversion in the worker thread right away.
-    if (image.format() != QImage::Format_ARGB32_Premultiplied)
-        image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-
-    return DynamicWallpaperImageAsyncResult(image);
-}
+public:
+    DynamicWallpaperFrameCacheKey key;
+    QImage image;
+    QSharedPointer<const KDynamicWallpaperReader> reader;
+};
 
 class DynamicWallpaperAsyncImageResponse : public QQuickImageResponse
 {
 public:
-    DynamicWallpaperAsyncImageResponse(const QString &fileName, int index, const QSize &requestedSize);
+    DynamicWallpaperAsyncImageResponse(const DynamicWallpaperImageHandle &handle, const QSize &requestedSize);
 
     QQuickTextureFactory *textureFactory() const override;
     QString errorString() const override;
+    void cancel() override;
 
 private Q_SLOTS:
+    void handleLookupFinished();
     void handleFinished();
 
 private:
-    QFutureWatcher<DynamicWallpaperImageAsyncResult> *m_watcher;
+    void load();
+
+    DynamicWallpaperFrameCacheKey m_key;
+    QSharedPointer<const KDynamicWallpaperReader> m_reader;
+    QFutureWatcher<DynamicWallpaperFrameLookup> *m_lookupWatcher = nullptr;
+    QFutureWatcher<QImage> *m_watcher = nullptr;
     QImage m_image;
     QString m_errorString;
+    bool m_isCanceled = false;
 };
 
-DynamicWallpaperAsyncImageResponse::DynamicWallpaperAsyncImageResponse(const QString &fileName,
-                                                                       int index,
+/*!
+ * \internal
+ *
+ * Looks up the frame with the specified \a handle in the frame cache, and, if it's not there,
+ * acquires the reader for the wallpaper. Both need to stat the file and the latter may need to
+ * open it, which can block on slow storage, so this runs on a worker thread.
+ */
+static DynamicWallpaperFrameLookup lookupFrame(const DynamicWallpaperImageHandle &handle, const QSize &requestedSize)
+{
+    const QFileInfo fileInfo(handle.fileName());
+
+    DynamicWallpaperFrameLookup lookup;
+    lookup.key = DynamicWallpaperFrameCacheKey(handle.fileName(), fileInfo.lastModified().toMSecsSinceEpoch(),
+                                               handle.imageIndex(), requestedSize, handle.isCropped());
+
+    // If the frame has been decoded recently, it can be served right away.
+    lookup.image = DynamicWallpaperFrameCache::instance()->load(lookup.key);
+    if (lookup.image.isNull()) {
+        // The reader is shared with the other layers and screens that show the same wallpaper,
+        // and it outlives this request, so the file is not parsed again at every transition.
+        lookup.reader = KDynamicWallpaperReaderPool::acquire(handle.fileName());
+    }
+
+    return lookup;
+}
+
+DynamicWallpaperAsyncImageResponse::DynamicWallpaperAsyncImageResponse(const DynamicWallpaperImageHandle &handle,
                                                                        const QSize &requestedSize)
 {
-    m_watcher = new QFutureWatcher<DynamicWallpaperImageAsyncResult>(this);
-    connect(m_watcher, &QFutureWatcher<DynamicWallpaperImageAsyncResult>::finished,
+    m_lookupWatcher = new QFutureWatcher<DynamicWallpaperFrameLookup>(this);
+    connect(m_lookupWatcher, &QFutureWatcher<DynamicWallpaperFrameLookup>::finished,
+            this, &DynamicWallpaperAsyncImageResponse::handleLookupFinished);
+    m_lookupWatcher->setFuture(QtConcurrent::run(lookupFrame, handle, requestedSize));
+}
+
+void DynamicWallpaperAsyncImageResponse::handleLookupFinished()
+{
+    const DynamicWallpaperFrameLookup lookup = m_lookupWatcher->result();
+    m_key = lookup.key;
+
+    if (m_isCanceled) {
+        m_errorString = QStringLiteral("The request has been canceled");
+    } else if (!lookup.image.isNull()) {
+        m_image = lookup.image;
+    } else {
+        // The reader may be shared with a request whose image has failed to decode, only give
+        // up if the file couldn't be opened. Decoding errors are reported by the image itself.
+        m_reader = lookup.reader;
+        if (m_reader->error() != KDynamicWallpaperReader::OpenError) {
+            load();
+            return;
+        }
+        m_errorString = m_reader->errorString();
+    }
+
+    emit finished();
+}
+
+void DynamicWallpaperAsyncImageResponse::load()
+{
+    const QSize imageSize = m_reader->imageSize(m_key.imageIndex);
+
+    // With the PreserveAspectCrop fill mode, everything outside the centered region with the
+    // aspect ratio of the screen is thrown away, so don't even convert it.
+    QRect sourceRect(QPoint(0, 0), imageSize);
+    if (m_key.isCropped && !m_key.size.isEmpty()) {
+        const QSize croppedSize = m_key.size.scaled(imageSize, Qt::KeepAspectRatio);
+        sourceRect = QRect(QPoint((imageSize.width() - croppedSize.width()) / 2,
+                                  (imageSize.height() - croppedSize.height()) / 2), croppedSize);
+    }
+
+    // If the requested image size is valid, scale the image so it covers the requested size
+    // while preserving the aspect ratio. That way, the Image item can still apply any fill
+    // mode. Note that the image is never scaled up.
+    QSize targetSize = sourceRect.size();
+    if (!m_key.size.isEmpty()) {
+        const QSize scaledSize = targetSize.scaled(m_key.size, Qt::KeepAspectRatioByExpanding);
+        if (scaledSize.width() <= targetSize.width() && scaledSize.height() <= targetSize.height())
+            targetSize = scaledSize;
+    }
+
+    // QtQuick wants images to have the format of ARGB32_Premultiplied, so let the reader write
+    // the pixels in that format right away.
+    m_watcher = new QFutureWatcher<QImage>(this);
+    connect(m_watcher, &QFutureWatcher<QImage>::finished,
             this, &DynamicWallpaperAsyncImageResponse::handleFinished);
-    m_watcher->setFuture(QtConcurrent::run(load, fileName, index, requestedSize));
+    m_watcher->setFuture(m_reader->imageAsync(m_key.imageIndex, targetSize, sourceRect,
+                                              QImage::Format_ARGB32_Premultiplied));
 }
 
 void DynamicWallpaperAsyncImageResponse::handleFinished()
 {
-    const DynamicWallpaperImageAsyncResult result = m_watcher->result();
-
-    if (result.errorString.isEmpty())
-        m_image = result.image;
-    else
-        m_errorString = result.errorString;
+    const QFuture<QImage> future = m_watcher->future();
+
+    if (future.isCanceled()) {
+        m_errorString = QStringLiteral("The request has been canceled");
+    } else {
+        m_image = future.result();
+        if (m_image.isNull())
+            m_errorString = m_reader->errorString();
+        else
+            DynamicWallpaperFrameCache::instance()->store(m_key, m_image);
+    }
 
     emit finished();
 }
@@ -82,8 +165,18 @@ QString DynamicWallpaperAsyncImageResponse::errorString() const
     return m_errorString;
 }
 
+void DynamicWallpaperAsyncImageResponse::cancel()
+{
+    // The image is no longer needed, e.g. because the wallpaper view has been reloaded, so
+    // stop decoding it. The finished() signal is still emitted when the decoder stops, or when
+    // the lookup finishes if decoding hasn't started yet.
+    m_isCanceled = true;
+    if (m_watcher)
+        m_watcher->cancel();
+}
+
 QQuickImageResponse *DynamicWallpaperImageProvider::requestImageResponse(const QString &id, const QSize &requestedSize)
 {
     const DynamicWallpaperImageHandle handle = DynamicWallpaperImageHandle::fromString(id);
-    return new DynamicWallpaperAsyncImageResponse(handle.fileName(), handle.imageIndex(), requestedSize);
+    return new DynamicWallpaperAsyncImageResponse(handle, requestedSize);
 }
@@ -9,6 +9,7 @@
 #include "dynamicwallpaperpreviewcache.h"
 
 #include <KDynamicWallpaperMetaData>
+#include <KDynamicWallpaperMetaDataTable>
 #include <KDynamicWallpaperReader>
 #include <KLocalizedString>
 
@@ -89,18 +90,22 @@ static QImage blend(const QImage &dark, const QImage &light, qreal delta)
 /*!
  * \internal
  *
- * Returns the approximate solar elevation for the specified wallpaper \a metadata.
+ * Returns the approximate solar elevation for every entry in the wallpaper \a metadata.
  */
-static qreal scoreForMetaData(const KDynamicWallpaperMetaData &metadata)
+static QVector<qreal> scoresForMetaData(const KDynamicWallpaperMetaDataTable &metadata)
 {
-    if (metadata.fields() & KDynamicWallpaperMetaData::SolarElevationField)
-        return metadata.solarElevation() / 90;
-    return std::cos(M_PI * (2 * metadata.time() + 1));
-}
-
-static bool score_compare(const KDynamicWallpaperMetaData &a, const KDynamicWallpaperMetaData &b)
-{
-    return scoreForMetaData(a) < scoreForMetaData(b);
+    const QVector<KDynamicWallpaperMetaData::MetaDataFields> fields = metadata.fields();
+    const QVector<qreal> solarElevations = metadata.solarElevations();
+    const QVector<qreal> times = metadata.times();
+
+    QVector<qreal> scores(metadata.count());
+    for (int i = 0; i < scores.count(); ++i) {
+        if (fields[i] & KDynamicWallpaperMetaData::SolarElevationField)
+            scores[i] = solarElevations[i] / 90;
+        else
+            scores[i] = std::cos(M_PI * (2 * times[i] + 1));
+    }
+    return scores;
 }
 
 /*!
@@ -120,17 +125,29 @@ static DynamicWallpaperImageAsyncResult makePreview(const QString &fileName, con
         if (reader.error() != KDynamicWallpaperReader::NoError)
             return DynamicWallpaperImageAsyncResult(reader.errorString());
 
-        const QList<KDynamicWallpaperMetaData> metadata = reader.metaData();
+        const KDynamicWallpaperMetaDataTable metadata = reader.metaDataTable();
         if (metadata.isEmpty())
             return DynamicWallpaperImageAsyncResult(i18n("Not a dynamic wallpaper"));
 
-        auto dark = std::min_element(metadata.begin(), metadata.end(), score_compare);
-        auto light = std::max_element(metadata.begin(), metadata.end(), score_compare);
+        const QVector<qreal> scores = scoresForMetaData(metadata);
+        auto dark = std::min_element(scores.begin(), scores.end());
+        auto light = std::max_element(scores.begin(), scores.end());
+
+        // The scores are per metadata row, translate the rows to the images they refer to.
+        const QVector<int> indices = metadata.indices();
+        const int darkIndex = indices[std::distance(scores.begin(), dark)];
+        const int lightIndex = indices[std::distance(scores.begin(), light)];
+
+        // The preview cache keeps previews at most 512x512 in size, so there's no point in
+        // decoding the images at full size. This also lets the reader use small renditions.
+        QSize previewSize = reader.imageSize(darkIndex);
+        if (previewSize.width() > 512 || previewSize.height() > 512)
+            previewSize.scale(512, 512, Qt::KeepAspectRatio);
 
-        const QImage darkImage = reader.image(std::distance(metadata.begin(), dark));
-        const QImage lightImage = reader.image(std::distance(metadata.begin(), light));
+        // Decode the dark and the light image in parallel.
+        const QVector<QImage> images = reader.images({ darkIndex, lightIndex }, previewSize);
 
-        preview = blend(darkImage, lightImage, 0.5);
+        preview = blend(images[0], images[1], 0.5);
 
         DynamicWallpaperPreviewCache::store(preview, fileName);
     }
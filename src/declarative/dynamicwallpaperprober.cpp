@@ -6,8 +6,7 @@
 
 #include "dynamicwallpaperprober.h"
 
-#include <KDynamicWallpaperMetaData>
-#include <KDynamicWallpaperReader>
+#include <KDynamicWallpaperInfo>
 
 /*!
  * \class DynamicWallpaperProber
@@ -40,8 +39,8 @@ DynamicWallpaperProber::~DynamicWallpaperProber()
 
 void DynamicWallpaperProber::run()
 {
-    const KDynamicWallpaperReader reader(m_fileUrl.toLocalFile());
-    if (reader.error() == KDynamicWallpaperReader::NoError)
+    const KDynamicWallpaperInfo info(m_fileUrl.toLocalFile());
+    if (info.error() == KDynamicWallpaperInfo::NoError)
         emit finished(m_fileUrl);
     else
         emit failed(m_fileUrl);
@@ -0,0 +1,46 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "kdynamicwallpapercbor_p.h"
+#include "kdynamicwallpapermetadatatable.h"
+
+#include <QCborMap>
+
+// Bump the version if the layout of the metadata changes in a way that older readers can't
+// cope with. Such readers will fall back to the XMP packet.
+static const qint64 s_version = 1;
+
+static const QLatin1String s_versionKey("Version");
+static const QLatin1String s_metaDataKey("MetaData");
+
+/*!
+ * \internal
+ *
+ * Extracts the dynamic wallpaper metadata from the specified binary metadata block \p cbor.
+ *
+ * Returns an empty table if the block is malformed or has been written by a newer version
+ * of the library.
+ */
+KDynamicWallpaperMetaDataTable KDynamicWallpaperCbor::parse(const QByteArray &cbor)
+{
+    const QCborMap map = QCborValue::fromCbor(cbor).toMap();
+    if (map.value(s_versionKey).toInteger() != s_version)
+        return KDynamicWallpaperMetaDataTable();
+    return KDynamicWallpaperMetaDataTable::fromCbor(map.value(s_metaDataKey));
+}
+
+/*!
+ * \internal
+ *
+ * Creates a binary metadata block that stores the specified dynamic wallpaper metadata \p table.
+ */
+QByteArray KDynamicWallpaperCbor::serialize(const KDynamicWallpaperMetaDataTable &table)
+{
+    QCborMap map;
+    map[s_versionKey] = s_version;
+    map[s_metaDataKey] = table.toCbor();
+    return map.toCborValue().toCbor();
+}
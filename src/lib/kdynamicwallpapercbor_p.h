@@ -0,0 +1,18 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <QByteArray>
+
+class KDynamicWallpaperMetaDataTable;
+
+class KDynamicWallpaperCbor
+{
+public:
+    static KDynamicWallpaperMetaDataTable parse(const QByteArray &cbor);
+    static QByteArray serialize(const KDynamicWallpaperMetaDataTable &table);
+};
@@ -0,0 +1,372 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "kdynamicwallpapereditor.h"
+#include "kdynamicwallpapercbor_p.h"
+#include "kdynamicwallpaperinfo.h"
+#include "kdynamicwallpaperisobmff_p.h"
+#include "kdynamicwallpapermetadata.h"
+#include "kdynamicwallpapermetadatatable.h"
+#include "kdynamicwallpaperxmp_p.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QHash>
+#include <QSaveFile>
+
+/*!
+ * \class KDynamicWallpaperEditor
+ * \brief The KDynamicWallpaperEditor class provides a way for editing dynamic wallpapers
+ * without encoding the images again.
+ *
+ * KDynamicWallpaperEditor loads an existing dynamic wallpaper, lets you replace its metadata
+ * with setMetaData() and remove, duplicate or reorder its images with setImageOrder(), and
+ * writes the result with save(). The compressed images are copied byte-for-byte, so editing a
+ * wallpaper takes a few milliseconds and never degrades the image quality.
+ *
+ * The images in a dynamic wallpaper are usually inter-coded, i.e. an image that is not a key
+ * frame can only be decoded after the images preceding it. setImageOrder() rejects orders that
+ * break such dependencies, use isKeyFrame() to find out where an image run may start.
+ *
+ * If any error occurs, error() will return an error code. You can call errorString() to get a
+ * human readable description of what went wrong.
+ */
+
+class KDynamicWallpaperEditorPrivate
+{
+public:
+    KDynamicWallpaperEditorPrivate();
+
+    bool load(QIODevice *device);
+    bool save(QIODevice *device);
+    bool isIdentityOrder() const;
+    void setError(KDynamicWallpaperEditor::WallpaperEditorError error, const QString &text);
+
+    KDynamicWallpaperEditor::WallpaperEditorError wallpaperEditorError;
+    QString errorString;
+    QByteArray data;
+    QVector<KDynamicWallpaperSample> samples;
+    QList<KDynamicWallpaperMetaData> metaData;
+    QVector<int> imageOrder;
+    int imageCount;
+};
+
+KDynamicWallpaperEditorPrivate::KDynamicWallpaperEditorPrivate()
+    : wallpaperEditorError(KDynamicWallpaperEditor::NoError)
+    , imageCount(0)
+{
+}
+
+void KDynamicWallpaperEditorPrivate::setError(KDynamicWallpaperEditor::WallpaperEditorError error, const QString &text)
+{
+    wallpaperEditorError = error;
+    errorString = text;
+}
+
+bool KDynamicWallpaperEditorPrivate::load(QIODevice *device)
+{
+    wallpaperEditorError = KDynamicWallpaperEditor::NoError;
+    errorString.clear();
+    data.clear();
+    samples.clear();
+    metaData.clear();
+    imageOrder.clear();
+    imageCount = 0;
+
+    if (device->isOpen()) {
+        if (!(device->openMode() & QIODevice::ReadOnly)) {
+            setError(KDynamicWallpaperEditor::OpenError, QStringLiteral("The device is not open for reading"));
+            return false;
+        }
+    } else {
+        if (!device->open(QIODevice::ReadOnly)) {
+            setError(KDynamicWallpaperEditor::OpenError, device->errorString());
+            return false;
+        }
+    }
+
+    data = device->readAll();
+
+    QBuffer buffer(&data);
+    KDynamicWallpaperInfo info(&buffer);
+    if (info.error() != KDynamicWallpaperInfo::NoError) {
+        setError(KDynamicWallpaperEditor::ReadError, info.errorString());
+        data.clear();
+        return false;
+    }
+
+    metaData = info.metaData();
+    imageCount = info.imageCount();
+
+    // Still images have no sample table, but their metadata can be edited all the same.
+    if (KDynamicWallpaperIsoBmff::readSamples(data, &samples) && samples.count() != imageCount)
+        samples.clear();
+
+    imageOrder.reserve(imageCount);
+    for (int i = 0; i < imageCount; ++i)
+        imageOrder.append(i);
+
+    return true;
+}
+
+bool KDynamicWallpaperEditorPrivate::isIdentityOrder() const
+{
+    if (imageOrder.count() != imageCount)
+        return false;
+    for (int i = 0; i < imageOrder.count(); ++i) {
+        if (imageOrder[i] != i)
+            return false;
+    }
+    return true;
+}
+
+bool KDynamicWallpaperEditorPrivate::save(QIODevice *device)
+{
+    wallpaperEditorError = KDynamicWallpaperEditor::NoError;
+    errorString.clear();
+
+    if (data.isEmpty()) {
+        setError(KDynamicWallpaperEditor::RemuxError, QStringLiteral("No wallpaper has been loaded"));
+        return false;
+    }
+
+    for (const KDynamicWallpaperMetaData &md : qAsConst(metaData)) {
+        if (md.index() < 0 || md.index() >= imageOrder.count()) {
+            setError(KDynamicWallpaperEditor::RemuxError,
+                     QStringLiteral("The metadata refers to image %1, which doesn't exist").arg(md.index()));
+            return false;
+        }
+    }
+
+    // The table drops invalid entries, which would leave the wallpaper with partial metadata.
+    const KDynamicWallpaperMetaDataTable table(metaData);
+    if (table.count() != metaData.count()) {
+        setError(KDynamicWallpaperEditor::RemuxError, QStringLiteral("The metadata contains invalid entries"));
+        return false;
+    }
+
+    const QByteArray xmp = KDynamicWallpaperXmp::serialize(table);
+
+    // If the images stay the same, only the metadata needs to be swapped.
+    QByteArray output;
+    if (isIdentityOrder()) {
+        output = data;
+        if (!KDynamicWallpaperIsoBmff::replaceMetaData(&output, xmp)) {
+            setError(KDynamicWallpaperEditor::RemuxError, QStringLiteral("Failed to store the metadata"));
+            return false;
+        }
+    } else if (!KDynamicWallpaperIsoBmff::remux(data, imageOrder, xmp, &output)) {
+        setError(KDynamicWallpaperEditor::RemuxError, QStringLiteral("Failed to remux the images"));
+        return false;
+    }
+
+    KDynamicWallpaperIsoBmff::replaceMetaDataBox(&output, KDynamicWallpaperCbor::serialize(table));
+
+    if (device->isOpen()) {
+        if (!(device->openMode() & QIODevice::WriteOnly)) {
+            setError(KDynamicWallpaperEditor::DeviceError, QStringLiteral("The device is not open for writing"));
+            return false;
+        }
+    } else {
+        if (!device->open(QIODevice::WriteOnly)) {
+            setError(KDynamicWallpaperEditor::DeviceError, device->errorString());
+            return false;
+        }
+    }
+
+    if (device->write(output) != output.size()) {
+        setError(KDynamicWallpaperEditor::DeviceError, device->errorString());
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * Constructs an empty KDynamicWallpaperEditor object.
+ */
+KDynamicWallpaperEditor::KDynamicWallpaperEditor()
+    : d(new KDynamicWallpaperEditorPrivate)
+{
+}
+
+/*!
+ * Destructs the KDynamicWallpaperEditor object.
+ */
+KDynamicWallpaperEditor::~KDynamicWallpaperEditor()
+{
+}
+
+/*!
+ * Loads the dynamic wallpaper from the specified \p device and returns \c true if successful;
+ * otherwise \c false is returned. The whole wallpaper is read into memory.
+ *
+ * If the device is not already open, KDynamicWallpaperEditor will attempt to open the device
+ * in QIODevice::ReadOnly mode by calling open().
+ */
+bool KDynamicWallpaperEditor::load(QIODevice *device)
+{
+    return d->load(device);
+}
+
+/*!
+ * Loads the dynamic wallpaper from the file \p fileName and returns \c true if successful;
+ * otherwise \c false is returned.
+ */
+bool KDynamicWallpaperEditor::load(const QString &fileName)
+{
+    QFile file(fileName);
+    return d->load(&file);
+}
+
+/*!
+ * Writes the edited dynamic wallpaper to the specified \p device and returns \c true if
+ * successful; otherwise \c false is returned.
+ *
+ * If the device is not already open, KDynamicWallpaperEditor will attempt to open the device
+ * in QIODevice::WriteOnly mode by calling open().
+ */
+bool KDynamicWallpaperEditor::save(QIODevice *device)
+{
+    return d->save(device);
+}
+
+/*!
+ * Writes the edited dynamic wallpaper to the file \p fileName and returns \c true if
+ * successful; otherwise \c false is returned. The file is replaced atomically, so it's safe to
+ * save the wallpaper to the file it has been loaded from.
+ */
+bool KDynamicWallpaperEditor::save(const QString &fileName)
+{
+    QSaveFile file(fileName);
+    if (!d->save(&file))
+        return false;
+
+    if (!file.commit()) {
+        d->setError(DeviceError, file.errorString());
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * Returns the number of images in the loaded dynamic wallpaper.
+ */
+int KDynamicWallpaperEditor::imageCount() const
+{
+    return d->imageCount;
+}
+
+/*!
+ * Returns \c true if the image with the specified \p imageIndex in the loaded dynamic wallpaper
+ * can be decoded on its own; otherwise \c false is returned.
+ */
+bool KDynamicWallpaperEditor::isKeyFrame(int imageIndex) const
+{
+    if (imageIndex < 0 || imageIndex >= d->imageCount)
+        return false;
+    if (d->samples.isEmpty())
+        return true;
+    return d->samples[imageIndex].isSyncSample;
+}
+
+/*!
+ * Replaces the metadata of the dynamic wallpaper with \p metaData. The indices in the metadata
+ * refer to the images in the order set with setImageOrder().
+ */
+void KDynamicWallpaperEditor::setMetaData(const QList<KDynamicWallpaperMetaData> &metaData)
+{
+    d->metaData = metaData;
+}
+
+/*!
+ * Returns the metadata of the dynamic wallpaper.
+ */
+QList<KDynamicWallpaperMetaData> KDynamicWallpaperEditor::metaData() const
+{
+    return d->metaData;
+}
+
+/*!
+ * Sets the images of the edited dynamic wallpaper to the images with the specified
+ * \p imageIndices in the loaded dynamic wallpaper. Images can be left out, repeated or moved
+ * around, as long as every image that is not a key frame directly follows its predecessor in
+ * the loaded wallpaper. Returns \c true if successful; otherwise \c false is returned.
+ *
+ * The indices in the metadata are updated to match the new order. Metadata that refers to a
+ * repeated image is copied for every copy of the image, and metadata that refers to an image
+ * that has been left out is dropped.
+ */
+bool KDynamicWallpaperEditor::setImageOrder(const QVector<int> &imageIndices)
+{
+    d->wallpaperEditorError = NoError;
+    d->errorString.clear();
+
+    if (imageIndices.isEmpty()) {
+        d->setError(ImageOrderError, QStringLiteral("A wallpaper must contain at least one image"));
+        return false;
+    }
+
+    for (int i = 0; i < imageIndices.count(); ++i) {
+        const int imageIndex = imageIndices[i];
+        if (imageIndex < 0 || imageIndex >= d->imageCount) {
+            d->setError(ImageOrderError, QStringLiteral("Image %1 doesn't exist").arg(imageIndex));
+            return false;
+        }
+        if (!isKeyFrame(imageIndex) && (i == 0 || imageIndices[i - 1] != imageIndex - 1)) {
+            d->setError(ImageOrderError,
+                        QStringLiteral("Image %1 is not a key frame and must follow image %2").arg(imageIndex).arg(imageIndex - 1));
+            return false;
+        }
+    }
+
+    // An image may appear several times in the new order, each copy gets the metadata.
+    QHash<int, QVector<int>> positions;
+    for (int i = 0; i < imageIndices.count(); ++i)
+        positions[imageIndices[i]].append(i);
+
+    QList<KDynamicWallpaperMetaData> metaData;
+    for (const KDynamicWallpaperMetaData &md : qAsConst(d->metaData)) {
+        const QVector<int> newIndices = positions.value(d->imageOrder.value(md.index(), -1));
+        for (int newIndex : newIndices) {
+            KDynamicWallpaperMetaData remappedMetaData = md;
+            remappedMetaData.setIndex(newIndex);
+            metaData.append(remappedMetaData);
+        }
+    }
+
+    d->metaData = metaData;
+    d->imageOrder = imageIndices;
+    return true;
+}
+
+/*!
+ * Returns the indices of the images in the loaded dynamic wallpaper that make up the edited
+ * dynamic wallpaper.
+ */
+QVector<int> KDynamicWallpaperEditor::imageOrder() const
+{
+    return d->imageOrder;
+}
+
+/*!
+ * Returns the type of the last error that occurred.
+ */
+KDynamicWallpaperEditor::WallpaperEditorError KDynamicWallpaperEditor::error() const
+{
+    return d->wallpaperEditorError;
+}
+
+/*!
+ * Returns the human readable description of the last error that occurred.
+ */
+QString KDynamicWallpaperEditor::errorString() const
+{
+    if (d->wallpaperEditorError == NoError)
+        return QStringLiteral("No error");
+    return d->errorString;
+}
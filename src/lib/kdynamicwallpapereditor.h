@@ -0,0 +1,52 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "kdynamicwallpaper_export.h"
+
+#include <QIODevice>
+#include <QVector>
+
+class KDynamicWallpaperMetaData;
+class KDynamicWallpaperEditorPrivate;
+
+class KDYNAMICWALLPAPER_EXPORT KDynamicWallpaperEditor
+{
+public:
+    enum WallpaperEditorError {
+        NoError,
+        OpenError,
+        ReadError,
+        DeviceError,
+        ImageOrderError,
+        RemuxError,
+    };
+
+    KDynamicWallpaperEditor();
+    ~KDynamicWallpaperEditor();
+
+    bool load(QIODevice *device);
+    bool load(const QString &fileName);
+
+    bool save(QIODevice *device);
+    bool save(const QString &fileName);
+
+    int imageCount() const;
+    bool isKeyFrame(int imageIndex) const;
+
+    void setMetaData(const QList<KDynamicWallpaperMetaData> &metaData);
+    QList<KDynamicWallpaperMetaData> metaData() const;
+
+    bool setImageOrder(const QVector<int> &imageIndices);
+    QVector<int> imageOrder() const;
+
+    WallpaperEditorError error() const;
+    QString errorString() const;
+
+private:
+    QScopedPointer<KDynamicWallpaperEditorPrivate> d;
+};
@@ -0,0 +1,135 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "kdynamicwallpaperencodecache_p.h"
+#include "kdynamicwallpaperencoderoptions.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QSaveFile>
+
+/*!
+ * \class KDynamicWallpaperEncodeCache
+ * \brief The KDynamicWallpaperEncodeCache class stores encoded wallpapers on disk.
+ *
+ * The cached wallpapers are keyed by a hash of the encoder options and the pixels of all
+ * images, so a wallpaper whose images haven't changed doesn't need to be encoded again even if
+ * its metadata has. The images are inter-coded, i.e. each frame depends on the previous ones,
+ * so the whole image sequence is cached rather than individual frames.
+ *
+ * \internal
+ */
+
+// Bump this whenever the encoder output changes for the same input.
+static const char s_cacheVersion[] = "kdynamicwallpaper-encode-cache-1";
+
+// The least recently used wallpapers are evicted when the cache grows past this size.
+static const qint64 s_maxCacheSize = 512 * 1024 * 1024;
+
+static QString cacheFileName(const QString &directory, const QByteArray &key)
+{
+    return directory + QLatin1Char('/') + QString::fromLatin1(key) + QStringLiteral(".avif");
+}
+
+static void prune(const QString &directory)
+{
+    const QDir cacheDirectory(directory);
+    const QFileInfoList entries = cacheDirectory.entryInfoList({QStringLiteral("*.avif")},
+                                                               QDir::Files, QDir::Time);
+
+    qint64 totalSize = 0;
+    for (const QFileInfo &entry : entries) {
+        totalSize += entry.size();
+        if (totalSize > s_maxCacheSize)
+            QFile::remove(entry.absoluteFilePath());
+    }
+}
+
+/*!
+ * Adds the specified encoder \p options to the \p hash.
+ */
+void KDynamicWallpaperEncodeCache::addOptions(QCryptographicHash *hash, const KDynamicWallpaperEncoderOptions &options)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << QByteArray(s_cacheVersion)
+           << qint32(options.codec())
+           << qint32(options.speed())
+           << qint32(options.minQuantizer())
+           << qint32(options.maxQuantizer())
+           << qint32(options.tileRowsLog2())
+           << qint32(options.tileColumnsLog2())
+           << qint32(options.chromaSubsampling())
+           << qint32(options.keyFrameInterval())
+           << options.renditionSizes();
+    hash->addData(data);
+}
+
+/*!
+ * Adds the pixels of the specified \p image to the \p hash. The image is hashed in the pixel
+ * format that is fed to the encoder, so images that only differ in their storage format have
+ * the same hash.
+ */
+void KDynamicWallpaperEncodeCache::addImage(QCryptographicHash *hash, const QImage &image)
+{
+    const QImage rgbImage = image.convertToFormat(QImage::Format_RGB888);
+
+    QByteArray header;
+    QDataStream stream(&header, QIODevice::WriteOnly);
+    stream << qint32(rgbImage.width()) << qint32(rgbImage.height());
+    hash->addData(header);
+
+    // Skip the padding at the end of each scanline, it's uninitialized.
+    const int rowSize = rgbImage.width() * 3;
+    for (int y = 0; y < rgbImage.height(); ++y)
+        hash->addData(reinterpret_cast<const char *>(rgbImage.constScanLine(y)), rowSize);
+}
+
+/*!
+ * Returns the encoded wallpaper with the given \p key in the cache \p directory, or an empty
+ * byte array if there is no such wallpaper.
+ */
+QByteArray KDynamicWallpaperEncodeCache::load(const QString &directory, const QByteArray &key)
+{
+    QFile file(cacheFileName(directory, key));
+    if (!file.open(QFile::ReadWrite))
+        return QByteArray();
+
+    // Mark the wallpaper as recently used so it's evicted last.
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+
+    return file.readAll();
+}
+
+/*!
+ * Stores the encoded wallpaper with the given \p key in the cache \p directory. The wallpaper
+ * consists of the concatenated \p parts. Returns \c true if successful; otherwise \c false is
+ * returned.
+ */
+bool KDynamicWallpaperEncodeCache::store(const QString &directory, const QByteArray &key, const QByteArrayList &parts)
+{
+    if (!QDir().mkpath(directory))
+        return false;
+
+    QSaveFile file(cacheFileName(directory, key));
+    if (!file.open(QFile::WriteOnly))
+        return false;
+    for (const QByteArray &part : parts) {
+        if (file.write(part) != part.size()) {
+            file.cancelWriting();
+            return false;
+        }
+    }
+    if (!file.commit())
+        return false;
+
+    prune(directory);
+    return true;
+}
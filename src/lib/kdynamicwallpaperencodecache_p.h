@@ -0,0 +1,25 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayList>
+#include <QString>
+
+class KDynamicWallpaperEncoderOptions;
+class QCryptographicHash;
+class QImage;
+
+class KDynamicWallpaperEncodeCache
+{
+public:
+    static void addOptions(QCryptographicHash *hash, const KDynamicWallpaperEncoderOptions &options);
+    static void addImage(QCryptographicHash *hash, const QImage &image);
+
+    static QByteArray load(const QString &directory, const QByteArray &key);
+    static bool store(const QString &directory, const QByteArray &key, const QByteArrayList &parts);
+};
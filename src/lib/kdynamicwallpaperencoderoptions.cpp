@@ -0,0 +1,273 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "kdynamicwallpaperencoderoptions.h"
+
+#include <QSharedData>
+
+/*!
+ * \class KDynamicWallpaperEncoderOptions
+ * \brief The KDynamicWallpaperEncoderOptions class specifies how KDynamicWallpaperWriter
+ * encodes images.
+ *
+ * The default options produce lossless 4:4:4 images with a single tile, which is the best
+ * possible quality. Lowering the quality and subsampling the chroma planes make the wallpaper
+ * smaller, and splitting images into tiles makes it faster to decode, as the tiles can be
+ * decoded in parallel.
+ *
+ * The images are encoded as an AV1 sequence, i.e. each image is predicted from the previous
+ * one, which makes time-lapses with similar images much smaller. Key frames, which can be
+ * decoded on their own, bound the amount of work needed to decode an image out of order.
+ *
+ * Downscaled renditions of the images can be embedded in the wallpaper as well, so previews
+ * and small screens don't need to decode the images at their full size.
+ */
+
+class KDynamicWallpaperEncoderOptionsPrivate : public QSharedData
+{
+public:
+    KDynamicWallpaperEncoderOptionsPrivate();
+
+    KDynamicWallpaperEncoderOptions::Codec codec;
+    KDynamicWallpaperEncoderOptions::ChromaSubsampling chromaSubsampling;
+    int speed;
+    int minQuantizer;
+    int maxQuantizer;
+    int tileRowsLog2;
+    int tileColumnsLog2;
+    int keyFrameInterval;
+    QVector<QSize> renditionSizes;
+};
+
+KDynamicWallpaperEncoderOptionsPrivate::KDynamicWallpaperEncoderOptionsPrivate()
+    : codec(KDynamicWallpaperEncoderOptions::AutomaticCodec)
+    , chromaSubsampling(KDynamicWallpaperEncoderOptions::Yuv444)
+    , speed(KDynamicWallpaperEncoderOptions::DefaultSpeed)
+    , minQuantizer(KDynamicWallpaperEncoderOptions::MinQuantizer)
+    , maxQuantizer(KDynamicWallpaperEncoderOptions::MinQuantizer)
+    , tileRowsLog2(0)
+    , tileColumnsLog2(0)
+    , keyFrameInterval(0)
+{
+}
+
+/*!
+ * Constructs a KDynamicWallpaperEncoderOptions object with default options.
+ */
+KDynamicWallpaperEncoderOptions::KDynamicWallpaperEncoderOptions()
+    : d(new KDynamicWallpaperEncoderOptionsPrivate)
+{
+}
+
+/*!
+ * Constructs a copy of the KDynamicWallpaperEncoderOptions object.
+ */
+KDynamicWallpaperEncoderOptions::KDynamicWallpaperEncoderOptions(const KDynamicWallpaperEncoderOptions &other)
+    : d(other.d)
+{
+}
+
+/*!
+ * Destructs the KDynamicWallpaperEncoderOptions object.
+ */
+KDynamicWallpaperEncoderOptions::~KDynamicWallpaperEncoderOptions()
+{
+}
+
+/*!
+ * Assigns the value of \p other to an encoder options object.
+ */
+KDynamicWallpaperEncoderOptions &KDynamicWallpaperEncoderOptions::operator=(const KDynamicWallpaperEncoderOptions &other)
+{
+    d = other.d;
+    return *this;
+}
+
+/*!
+ * Returns \c true if all options are within their valid ranges; otherwise \c false.
+ */
+bool KDynamicWallpaperEncoderOptions::isValid() const
+{
+    if (d->speed != DefaultSpeed && (d->speed < MinSpeed || d->speed > MaxSpeed))
+        return false;
+    if (d->minQuantizer < MinQuantizer || d->minQuantizer > MaxQuantizer)
+        return false;
+    if (d->maxQuantizer < MinQuantizer || d->maxQuantizer > MaxQuantizer)
+        return false;
+    if (d->minQuantizer > d->maxQuantizer)
+        return false;
+    if (d->tileRowsLog2 < 0 || d->tileRowsLog2 > MaxTilesLog2)
+        return false;
+    if (d->tileColumnsLog2 < 0 || d->tileColumnsLog2 > MaxTilesLog2)
+        return false;
+    if (d->keyFrameInterval < 0)
+        return false;
+    for (const QSize &size : qAsConst(d->renditionSizes)) {
+        if (size.isEmpty())
+            return false;
+    }
+    return true;
+}
+
+/*!
+ * Sets the AV1 codec that will be used to encode images to \p codec.
+ *
+ * If the codec is AutomaticCodec, the best available codec is picked.
+ */
+void KDynamicWallpaperEncoderOptions::setCodec(Codec codec)
+{
+    d->codec = codec;
+}
+
+/*!
+ * Returns the AV1 codec that will be used to encode images.
+ */
+KDynamicWallpaperEncoderOptions::Codec KDynamicWallpaperEncoderOptions::codec() const
+{
+    return d->codec;
+}
+
+/*!
+ * Sets the speed preset of the encoder to \p speed, ranging from MinSpeed (slowest, best
+ * compression) to MaxSpeed (fastest). DefaultSpeed lets the codec choose.
+ */
+void KDynamicWallpaperEncoderOptions::setSpeed(int speed)
+{
+    d->speed = speed;
+}
+
+/*!
+ * Returns the speed preset of the encoder.
+ */
+int KDynamicWallpaperEncoderOptions::speed() const
+{
+    return d->speed;
+}
+
+/*!
+ * Sets the lowest quantizer the encoder may use to \p quantizer, ranging from MinQuantizer
+ * (lossless) to MaxQuantizer (worst quality).
+ */
+void KDynamicWallpaperEncoderOptions::setMinQuantizer(int quantizer)
+{
+    d->minQuantizer = quantizer;
+}
+
+/*!
+ * Returns the lowest quantizer the encoder may use.
+ */
+int KDynamicWallpaperEncoderOptions::minQuantizer() const
+{
+    return d->minQuantizer;
+}
+
+/*!
+ * Sets the highest quantizer the encoder may use to \p quantizer, ranging from MinQuantizer
+ * (lossless) to MaxQuantizer (worst quality).
+ */
+void KDynamicWallpaperEncoderOptions::setMaxQuantizer(int quantizer)
+{
+    d->maxQuantizer = quantizer;
+}
+
+/*!
+ * Returns the highest quantizer the encoder may use.
+ */
+int KDynamicWallpaperEncoderOptions::maxQuantizer() const
+{
+    return d->maxQuantizer;
+}
+
+/*!
+ * Sets the base 2 logarithm of the number of tile rows to \p tileRowsLog2.
+ */
+void KDynamicWallpaperEncoderOptions::setTileRowsLog2(int tileRowsLog2)
+{
+    d->tileRowsLog2 = tileRowsLog2;
+}
+
+/*!
+ * Returns the base 2 logarithm of the number of tile rows.
+ */
+int KDynamicWallpaperEncoderOptions::tileRowsLog2() const
+{
+    return d->tileRowsLog2;
+}
+
+/*!
+ * Sets the base 2 logarithm of the number of tile columns to \p tileColumnsLog2.
+ */
+void KDynamicWallpaperEncoderOptions::setTileColumnsLog2(int tileColumnsLog2)
+{
+    d->tileColumnsLog2 = tileColumnsLog2;
+}
+
+/*!
+ * Returns the base 2 logarithm of the number of tile columns.
+ */
+int KDynamicWallpaperEncoderOptions::tileColumnsLog2() const
+{
+    return d->tileColumnsLog2;
+}
+
+/*!
+ * Sets the chroma subsampling of the encoded images to \p subsampling.
+ */
+void KDynamicWallpaperEncoderOptions::setChromaSubsampling(ChromaSubsampling subsampling)
+{
+    d->chromaSubsampling = subsampling;
+}
+
+/*!
+ * Returns the chroma subsampling of the encoded images.
+ */
+KDynamicWallpaperEncoderOptions::ChromaSubsampling KDynamicWallpaperEncoderOptions::chromaSubsampling() const
+{
+    return d->chromaSubsampling;
+}
+
+/*!
+ * Sets the number of images between two consecutive key frames to \p interval. If the interval
+ * is 0, which is the default, only the first image is a key frame and every other image is
+ * predicted from its predecessor. An interval of 1 makes every image a key frame.
+ *
+ * Shorter intervals make the wallpaper bigger, but make it faster to decode an image that
+ * doesn't follow the previously decoded one.
+ */
+void KDynamicWallpaperEncoderOptions::setKeyFrameInterval(int interval)
+{
+    d->keyFrameInterval = interval;
+}
+
+/*!
+ * Returns the number of images between two consecutive key frames, or 0 if only the first
+ * image is a key frame.
+ */
+int KDynamicWallpaperEncoderOptions::keyFrameInterval() const
+{
+    return d->keyFrameInterval;
+}
+
+/*!
+ * Sets the sizes of the downscaled renditions that will be embedded along with the images to
+ * \p sizes. Each image is scaled to fit in every size while keeping its aspect ratio; sizes
+ * that the image already fits in are skipped.
+ *
+ * KDynamicWallpaperReader picks the smallest rendition that satisfies the requested image size.
+ * By default, no renditions are embedded.
+ */
+void KDynamicWallpaperEncoderOptions::setRenditionSizes(const QVector<QSize> &sizes)
+{
+    d->renditionSizes = sizes;
+}
+
+/*!
+ * Returns the sizes of the downscaled renditions that will be embedded along with the images.
+ */
+QVector<QSize> KDynamicWallpaperEncoderOptions::renditionSizes() const
+{
+    return d->renditionSizes;
+}
@@ -0,0 +1,77 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "kdynamicwallpaper_export.h"
+
+#include <QSharedDataPointer>
+#include <QSize>
+#include <QVector>
+
+class KDynamicWallpaperEncoderOptionsPrivate;
+
+class KDYNAMICWALLPAPER_EXPORT KDynamicWallpaperEncoderOptions
+{
+public:
+    enum Codec {
+        AutomaticCodec,
+        AomCodec,
+        Rav1eCodec,
+        SvtCodec,
+    };
+
+    enum ChromaSubsampling {
+        Yuv444,
+        Yuv422,
+        Yuv420,
+    };
+
+    KDynamicWallpaperEncoderOptions();
+    KDynamicWallpaperEncoderOptions(const KDynamicWallpaperEncoderOptions &other);
+    ~KDynamicWallpaperEncoderOptions();
+
+    KDynamicWallpaperEncoderOptions &operator=(const KDynamicWallpaperEncoderOptions &other);
+
+    bool isValid() const;
+
+    void setCodec(Codec codec);
+    Codec codec() const;
+
+    void setSpeed(int speed);
+    int speed() const;
+
+    void setMinQuantizer(int quantizer);
+    int minQuantizer() const;
+
+    void setMaxQuantizer(int quantizer);
+    int maxQuantizer() const;
+
+    void setTileRowsLog2(int tileRowsLog2);
+    int tileRowsLog2() const;
+
+    void setTileColumnsLog2(int tileColumnsLog2);
+    int tileColumnsLog2() const;
+
+    void setChromaSubsampling(ChromaSubsampling subsampling);
+    ChromaSubsampling chromaSubsampling() const;
+
+    void setKeyFrameInterval(int interval);
+    int keyFrameInterval() const;
+
+    void setRenditionSizes(const QVector<QSize> &sizes);
+    QVector<QSize> renditionSizes() const;
+
+    static const int DefaultSpeed = -1;
+    static const int MinSpeed = 0;
+    static const int MaxSpeed = 10;
+    static const int MinQuantizer = 0;
+    static const int MaxQuantizer = 63;
+    static const int MaxTilesLog2 = 6;
+
+private:
+    QSharedDataPointer<KDynamicWallpaperEncoderOptionsPrivate> d;
+};
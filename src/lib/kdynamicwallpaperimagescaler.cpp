@@ -0,0 +1,330 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "kdynamicwallpaperimagescaler_p.h"
+
+#include <QVector>
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*!
+ * \internal
+ * \class KDynamicWallpaperImageScaler
+ * \brief The KDynamicWallpaperImageScaler class converts decoded YUV images straight into
+ * downscaled RGB images.
+ *
+ * The YUV planes are downscaled with an area filter and the averaged samples are converted to
+ * RGB right away, so no intermediate full-size RGB buffer is ever allocated. Since the color
+ * conversion is an affine transform, averaging in the YUV space produces the same result as
+ * averaging in the RGB space, except for the clamping.
+ */
+
+class KDynamicWallpaperYuvCoefficients
+{
+public:
+    float kr;
+    float kb;
+};
+
+static bool yuvCoefficients(avifMatrixCoefficients matrixCoefficients, KDynamicWallpaperYuvCoefficients *coefficients)
+{
+    switch (matrixCoefficients) {
+    case AVIF_MATRIX_COEFFICIENTS_BT709:
+        *coefficients = { 0.2126f, 0.0722f };
+        return true;
+    case AVIF_MATRIX_COEFFICIENTS_UNSPECIFIED:
+    case AVIF_MATRIX_COEFFICIENTS_BT470BG:
+    case AVIF_MATRIX_COEFFICIENTS_BT601:
+        *coefficients = { 0.299f, 0.114f };
+        return true;
+    case AVIF_MATRIX_COEFFICIENTS_FCC:
+        *coefficients = { 0.30f, 0.11f };
+        return true;
+    case AVIF_MATRIX_COEFFICIENTS_SMPTE240:
+        *coefficients = { 0.212f, 0.087f };
+        return true;
+    case AVIF_MATRIX_COEFFICIENTS_BT2020_NCL:
+        *coefficients = { 0.2627f, 0.0593f };
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*!
+ * Returns \c true if the specified \p image can be scaled by the KDynamicWallpaperImageScaler
+ * into an image with the given \p format; otherwise returns \c false. Images with unsupported
+ * bit depths, matrix coefficients or pixel formats have to be converted by libavif.
+ */
+bool KDynamicWallpaperImageScaler::canScale(const avifImage *image, QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888:
+    case QImage::Format_RGBA8888_Premultiplied:
+    case QImage::Format_RGB888:
+        break;
+    default:
+        return false;
+    }
+
+    KDynamicWallpaperYuvCoefficients coefficients;
+    if (image->depth != 8)
+        return false;
+    return yuvCoefficients(image->matrixCoefficients, &coefficients);
+}
+
+/*!
+ * \internal
+ *
+ * Adds the samples in \p row to the accumulator \p sums.
+ */
+static void accumulateRow(const uint8_t *row, uint32_t *sums, int count)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+        const __m128i lo = _mm_unpacklo_epi8(samples, zero);
+        const __m128i hi = _mm_unpackhi_epi8(samples, zero);
+
+        __m128i *out = reinterpret_cast<__m128i *>(sums + i);
+        _mm_storeu_si128(out + 0, _mm_add_epi32(_mm_loadu_si128(out + 0), _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(out + 1, _mm_add_epi32(_mm_loadu_si128(out + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(out + 2, _mm_add_epi32(_mm_loadu_si128(out + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(out + 3, _mm_add_epi32(_mm_loadu_si128(out + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16_t samples = vld1q_u8(row + i);
+        const uint16x8_t lo = vmovl_u8(vget_low_u8(samples));
+        const uint16x8_t hi = vmovl_u8(vget_high_u8(samples));
+
+        uint32_t *out = sums + i;
+        vst1q_u32(out + 0, vaddw_u16(vld1q_u32(out + 0), vget_low_u16(lo)));
+        vst1q_u32(out + 4, vaddw_u16(vld1q_u32(out + 4), vget_high_u16(lo)));
+        vst1q_u32(out + 8, vaddw_u16(vld1q_u32(out + 8), vget_low_u16(hi)));
+        vst1q_u32(out + 12, vaddw_u16(vld1q_u32(out + 12), vget_high_u16(hi)));
+    }
+#endif
+
+    for (; i < count; ++i)
+        sums[i] += row[i];
+}
+
+/*!
+ * \internal
+ *
+ * Precomputed mapping from destination columns to ranges of source columns.
+ */
+class KDynamicWallpaperSpan
+{
+public:
+    int from;
+    int to;
+};
+
+static QVector<KDynamicWallpaperSpan> computeSpans(int sourceOffset, int sourceLength, int targetLength, int shift)
+{
+    QVector<KDynamicWallpaperSpan> spans(targetLength);
+    for (int i = 0; i < targetLength; ++i) {
+        const int begin = int(qint64(i) * sourceLength / targetLength);
+        const int end = std::max(int(qint64(i + 1) * sourceLength / targetLength), begin + 1);
+        spans[i].from = (sourceOffset + begin) >> shift;
+        spans[i].to = ((sourceOffset + end - 1) >> shift) + 1;
+    }
+    return spans;
+}
+
+/*!
+ * \internal
+ *
+ * Sums the samples of plane \p planeIndex that fall within \p rows, and then reduces the sums
+ * horizontally according to \p columns. The averages are written to \p averages.
+ */
+static void averagePlane(const avifImage *image, int planeIndex, const KDynamicWallpaperSpan &rows,
+                         const QVector<KDynamicWallpaperSpan> &columns, QVector<uint32_t> *sums,
+                         float *averages)
+{
+    const int from = columns.first().from;
+    const int to = columns.last().to;
+
+    std::fill(sums->begin(), sums->begin() + (to - from), 0);
+
+    const uint8_t *plane = image->yuvPlanes[planeIndex];
+    const uint32_t rowBytes = image->yuvRowBytes[planeIndex];
+    for (int y = rows.from; y < rows.to; ++y)
+        accumulateRow(plane + y * rowBytes + from, sums->data(), to - from);
+
+    const uint32_t *data = sums->constData() - from;
+    const int rowCount = rows.to - rows.from;
+    for (int i = 0; i < columns.count(); ++i) {
+        // A single column sum fits in 32 bits, but a whole block of an extreme downscale, e.g.
+        // an 8K image scaled down to a few pixels, doesn't.
+        uint64_t sum = 0;
+        for (int x = columns[i].from; x < columns[i].to; ++x)
+            sum += data[x];
+        averages[i] = float(sum) / float(qint64(rowCount) * (columns[i].to - columns[i].from));
+    }
+}
+
+static inline uint8_t clampToByte(float value)
+{
+    return uint8_t(std::min(255.0f, std::max(0.0f, value + 0.5f)));
+}
+
+class KDynamicWallpaperYuvToRgb
+{
+public:
+    float lumaOffset;
+    float lumaScale;
+    float crToR;
+    float cbToB;
+    float cbToG;
+    float crToG;
+};
+
+/*!
+ * \internal
+ *
+ * Converts a row of averaged YUV samples to RGB and stores it in the \p scanLine with the pixel
+ * layout of the given \p format. The pixels are opaque, so the premultiplied formats share the
+ * layout with their straight counterparts.
+ */
+template <QImage::Format format>
+static void storeRow(uchar *scanLine, const float *luma, const float *cb, const float *cr, int width,
+                     const KDynamicWallpaperYuvToRgb &conversion)
+{
+    for (int x = 0; x < width; ++x) {
+        const float Y = (luma[x] - conversion.lumaOffset) * conversion.lumaScale;
+        const float U = cb[x] - 128.0f;
+        const float V = cr[x] - 128.0f;
+
+        const uint8_t red = clampToByte(Y + conversion.crToR * V);
+        const uint8_t green = clampToByte(Y - conversion.cbToG * U - conversion.crToG * V);
+        const uint8_t blue = clampToByte(Y + conversion.cbToB * U);
+
+        switch (format) {
+        case QImage::Format_RGBA8888:
+            scanLine[4 * x + 0] = red;
+            scanLine[4 * x + 1] = green;
+            scanLine[4 * x + 2] = blue;
+            scanLine[4 * x + 3] = 0xff;
+            break;
+        case QImage::Format_RGB888:
+            scanLine[3 * x + 0] = red;
+            scanLine[3 * x + 1] = green;
+            scanLine[3 * x + 2] = blue;
+            break;
+        default:
+            reinterpret_cast<QRgb *>(scanLine)[x] = qRgb(red, green, blue);
+            break;
+        }
+    }
+}
+
+/*!
+ * Converts the region \p sourceRect of the given YUV \p image to an RGB image with the specified
+ * \p size and \p format. Only the formats accepted by canScale() are supported.
+ *
+ * This function should be used only for downscaling; it falls back to the nearest neighbor
+ * filter when upscaling.
+ */
+QImage KDynamicWallpaperImageScaler::scale(const avifImage *image, const QRect &sourceRect,
+                                           const QSize &size, QImage::Format format)
+{
+    void (*store)(uchar *, const float *, const float *, const float *, int, const KDynamicWallpaperYuvToRgb &);
+    switch (format) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+        store = storeRow<QImage::Format_RGB32>;
+        break;
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888:
+    case QImage::Format_RGBA8888_Premultiplied:
+        store = storeRow<QImage::Format_RGBA8888>;
+        break;
+    case QImage::Format_RGB888:
+        store = storeRow<QImage::Format_RGB888>;
+        break;
+    default:
+        return QImage();
+    }
+
+    KDynamicWallpaperYuvCoefficients coefficients;
+    if (image->depth != 8 || !yuvCoefficients(image->matrixCoefficients, &coefficients))
+        return QImage();
+    if (sourceRect.isEmpty() || size.isEmpty())
+        return QImage();
+
+    QImage result(size, format);
+    if (result.isNull())
+        return QImage();
+
+    int chromaShiftX = 0;
+    int chromaShiftY = 0;
+    const bool hasChroma = image->yuvFormat != AVIF_PIXEL_FORMAT_YUV400 && image->yuvPlanes[AVIF_CHAN_U];
+    switch (image->yuvFormat) {
+    case AVIF_PIXEL_FORMAT_YUV420:
+        chromaShiftY = 1;
+        Q_FALLTHROUGH();
+    case AVIF_PIXEL_FORMAT_YUV422:
+        chromaShiftX = 1;
+        break;
+    default:
+        break;
+    }
+
+    const QVector<KDynamicWallpaperSpan> lumaColumns = computeSpans(sourceRect.x(), sourceRect.width(), size.width(), 0);
+    const QVector<KDynamicWallpaperSpan> chromaColumns = computeSpans(sourceRect.x(), sourceRect.width(), size.width(), chromaShiftX);
+    const QVector<KDynamicWallpaperSpan> lumaRows = computeSpans(sourceRect.y(), sourceRect.height(), size.height(), 0);
+    const QVector<KDynamicWallpaperSpan> chromaRows = computeSpans(sourceRect.y(), sourceRect.height(), size.height(), chromaShiftY);
+
+    // Limited range samples have to be expanded to the full range.
+    const bool isFullRange = image->yuvRange == AVIF_RANGE_FULL;
+    const float chromaScale = isFullRange ? 1.0f : 255.0f / 224.0f;
+
+    const float kr = coefficients.kr;
+    const float kb = coefficients.kb;
+    const float kg = 1.0f - kr - kb;
+
+    KDynamicWallpaperYuvToRgb conversion;
+    conversion.lumaOffset = isFullRange ? 0.0f : 16.0f;
+    conversion.lumaScale = isFullRange ? 1.0f : 255.0f / 219.0f;
+    conversion.crToR = (2.0f - 2.0f * kr) * chromaScale;
+    conversion.cbToB = (2.0f - 2.0f * kb) * chromaScale;
+    conversion.cbToG = (2.0f * kb * (1.0f - kb) / kg) * chromaScale;
+    conversion.crToG = (2.0f * kr * (1.0f - kr) / kg) * chromaScale;
+
+    QVector<uint32_t> sums(sourceRect.width() + 1);
+    QVector<float> luma(size.width());
+    QVector<float> cb(size.width(), 128.0f);
+    QVector<float> cr(size.width(), 128.0f);
+
+    for (int y = 0; y < size.height(); ++y) {
+        averagePlane(image, AVIF_CHAN_Y, lumaRows[y], lumaColumns, &sums, luma.data());
+        if (hasChroma) {
+            averagePlane(image, AVIF_CHAN_U, chromaRows[y], chromaColumns, &sums, cb.data());
+            averagePlane(image, AVIF_CHAN_V, chromaRows[y], chromaColumns, &sums, cr.data());
+        }
+
+        store(result.scanLine(y), luma.constData(), cb.constData(), cr.constData(), size.width(), conversion);
+    }
+
+    return result;
+}
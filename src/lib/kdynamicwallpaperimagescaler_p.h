@@ -0,0 +1,19 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <QImage>
+#include <QRect>
+
+#include <avif/avif.h>
+
+class KDynamicWallpaperImageScaler
+{
+public:
+    static bool canScale(const avifImage *image, QImage::Format format);
+    static QImage scale(const avifImage *image, const QRect &sourceRect, const QSize &size, QImage::Format format);
+};
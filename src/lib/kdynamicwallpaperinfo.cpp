@@ -0,0 +1,491 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "kdynamicwallpaperinfo.h"
+#include "kdynamicwallpapercbor_p.h"
+#include "kdynamicwallpaperisobmff_p.h"
+#include "kdynamicwallpapermetadata.h"
+#include "kdynamicwallpapermetadatatable.h"
+#include "kdynamicwallpaperxmp_p.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QHash>
+#include <QVector>
+#include <QtEndian>
+
+/*!
+ * \class KDynamicWallpaperInfo
+ * \brief The KDynamicWallpaperInfo class provides a cheap way for inspecting dynamic wallpapers.
+ *
+ * Unlike KDynamicWallpaperReader, KDynamicWallpaperInfo never touches the image payloads. It
+ * only walks the boxes that describe the structure of the file, e.g. ftyp, meta and moov, and
+ * reads the dynamic wallpaper metadata, either from the binary metadata block or, if the file
+ * has none, from the XMP packet. Typically, inspecting a
+ * dynamic wallpaper takes a few kilobytes of I/O, no matter how large the file is.
+ *
+ * If the device doesn't contain a dynamic wallpaper, error() will return an error code. You can
+ * call errorString() to get a human readable description of what went wrong.
+ */
+
+// Reading boxes that are larger than this is likely to be a waste of memory. Note that the
+// boxes we are interested in normally take a few kilobytes.
+static const qint64 s_maxBoxSize = 16 * 1024 * 1024;
+
+class KDynamicWallpaperInfoPrivate
+{
+public:
+    KDynamicWallpaperInfoPrivate();
+
+    bool open();
+    void close();
+
+    bool readMeta(const QByteArray &payload);
+    bool readMovie(const QByteArray &payload);
+    void readMetaDataBox(const KDynamicWallpaperBox &box);
+    bool readMetaData();
+    void setError(KDynamicWallpaperInfo::WallpaperInfoError error, const QString &text);
+
+    QIODevice *device;
+    KDynamicWallpaperInfo::WallpaperInfoError wallpaperInfoError;
+    QString errorString;
+    KDynamicWallpaperMetaDataTable metaData;
+    QHash<quint32, KDynamicWallpaperItem> items;
+    QByteArray itemData;
+    quint32 primaryItemId;
+    int trackSampleCount;
+    QSize trackSize;
+    bool isDeviceForeign;
+};
+
+KDynamicWallpaperInfoPrivate::KDynamicWallpaperInfoPrivate()
+    : device(nullptr)
+    , wallpaperInfoError(KDynamicWallpaperInfo::NoError)
+    , primaryItemId(0)
+    , trackSampleCount(-1)
+    , isDeviceForeign(false)
+{
+}
+
+bool KDynamicWallpaperInfoPrivate::readMeta(const QByteArray &payload)
+{
+    // The meta box is a full box, skip the version and the flags.
+    const QVector<KDynamicWallpaperBox> boxes = KDynamicWallpaperIsoBmff::parseBoxes(payload, 4);
+
+    for (const KDynamicWallpaperBox &box : boxes) {
+        const QByteArray data = KDynamicWallpaperIsoBmff::boxPayload(payload, box);
+        switch (box.type) {
+        case fourcc("pitm"): {
+            QDataStream stream(data);
+            quint8 version;
+            stream >> version;
+            stream.skipRawData(3);
+            if (version == 0) {
+                quint16 itemId;
+                stream >> itemId;
+                primaryItemId = itemId;
+            } else {
+                stream >> primaryItemId;
+            }
+            break;
+        }
+        case fourcc("iinf"):
+            KDynamicWallpaperIsoBmff::readItemInfo(data, &items);
+            break;
+        case fourcc("idat"):
+            itemData = QByteArray(data.constData(), data.size());
+            break;
+        default:
+            break;
+        }
+    }
+
+    // The item locations and the item properties refer to the items declared in the item
+    // information box, so they can be read only after all the items are known.
+    for (const KDynamicWallpaperBox &box : boxes) {
+        if (box.type == fourcc("iloc")) {
+            if (!KDynamicWallpaperIsoBmff::readItemLocations(KDynamicWallpaperIsoBmff::boxPayload(payload, box), &items))
+                return false;
+        } else if (box.type == fourcc("iprp")) {
+            KDynamicWallpaperIsoBmff::readItemProperties(KDynamicWallpaperIsoBmff::boxPayload(payload, box), &items);
+        }
+    }
+
+    return true;
+}
+
+bool KDynamicWallpaperInfoPrivate::readMovie(const QByteArray &payload)
+{
+    const QVector<KDynamicWallpaperBox> boxes = KDynamicWallpaperIsoBmff::parseBoxes(payload);
+    for (const KDynamicWallpaperBox &trak : boxes) {
+        if (trak.type != fourcc("trak"))
+            continue;
+
+        const QByteArray trakData = KDynamicWallpaperIsoBmff::boxPayload(payload, trak);
+        const QVector<KDynamicWallpaperBox> trakBoxes = KDynamicWallpaperIsoBmff::parseBoxes(trakData);
+
+        const KDynamicWallpaperBox *tkhd = KDynamicWallpaperIsoBmff::findBox(trakBoxes, fourcc("tkhd"));
+        const KDynamicWallpaperBox *mdia = KDynamicWallpaperIsoBmff::findBox(trakBoxes, fourcc("mdia"));
+        if (!tkhd || !mdia)
+            continue;
+
+        const QByteArray mdiaData = KDynamicWallpaperIsoBmff::boxPayload(trakData, *mdia);
+        const QVector<KDynamicWallpaperBox> mdiaBoxes = KDynamicWallpaperIsoBmff::parseBoxes(mdiaData);
+
+        // Only picture tracks contain images, ignore everything else.
+        const KDynamicWallpaperBox *hdlr = KDynamicWallpaperIsoBmff::findBox(mdiaBoxes, fourcc("hdlr"));
+        if (!hdlr || KDynamicWallpaperIsoBmff::boxPayload(mdiaData, *hdlr).mid(8, 4) != QByteArrayLiteral("pict"))
+            continue;
+
+        const KDynamicWallpaperBox *minf = KDynamicWallpaperIsoBmff::findBox(mdiaBoxes, fourcc("minf"));
+        if (!minf)
+            continue;
+
+        const QByteArray minfData = KDynamicWallpaperIsoBmff::boxPayload(mdiaData, *minf);
+        const QVector<KDynamicWallpaperBox> minfBoxes = KDynamicWallpaperIsoBmff::parseBoxes(minfData);
+        const KDynamicWallpaperBox *stbl = KDynamicWallpaperIsoBmff::findBox(minfBoxes, fourcc("stbl"));
+        if (!stbl)
+            continue;
+
+        const QByteArray stblData = KDynamicWallpaperIsoBmff::boxPayload(minfData, *stbl);
+        const QVector<KDynamicWallpaperBox> stblBoxes = KDynamicWallpaperIsoBmff::parseBoxes(stblData);
+        const KDynamicWallpaperBox *stsz = KDynamicWallpaperIsoBmff::findBox(stblBoxes, fourcc("stsz"));
+        if (!stsz)
+            continue;
+
+        QDataStream sampleSizeStream(KDynamicWallpaperIsoBmff::boxPayload(stblData, *stsz));
+        quint32 sampleSize, sampleCount;
+        sampleSizeStream.skipRawData(4);
+        sampleSizeStream >> sampleSize >> sampleCount;
+        if (sampleSizeStream.status() != QDataStream::Ok)
+            return false;
+
+        // The width and the height are stored as 16.16 fixed-point numbers at the very end.
+        const QByteArray tkhdData = KDynamicWallpaperIsoBmff::boxPayload(trakData, *tkhd);
+        if (tkhdData.size() >= 8) {
+            const uchar *tail = reinterpret_cast<const uchar *>(tkhdData.constData() + tkhdData.size() - 8);
+            trackSize = QSize(qFromBigEndian<quint32>(tail) >> 16, qFromBigEndian<quint32>(tail + 4) >> 16);
+        }
+
+        trackSampleCount = sampleCount;
+        return true;
+    }
+
+    return true;
+}
+
+void KDynamicWallpaperInfoPrivate::readMetaDataBox(const KDynamicWallpaperBox &box)
+{
+    if (box.size > s_maxBoxSize || !device->seek(box.offset + box.headerSize))
+        return;
+
+    const QByteArray header = device->read(KDynamicWallpaperIsoBmff::metaDataHeaderSize);
+    if (!KDynamicWallpaperIsoBmff::isMetaDataBox(header, box))
+        return;
+
+    // A malformed or newer metadata block is not fatal, the XMP packet will be used instead.
+    const QByteArray cbor = device->read(box.size - box.headerSize - KDynamicWallpaperIsoBmff::metaDataHeaderSize);
+    metaData = KDynamicWallpaperCbor::parse(cbor);
+}
+
+bool KDynamicWallpaperInfoPrivate::readMetaData()
+{
+    for (const KDynamicWallpaperItem &item : qAsConst(items)) {
+        if (item.type != fourcc("mime") || item.contentType != QByteArrayLiteral("application/rdf+xml"))
+            continue;
+
+        QByteArray xmp;
+        for (const KDynamicWallpaperItemExtent &extent : item.extents) {
+            if (extent.length > quint64(s_maxBoxSize))
+                return false;
+
+            const quint64 offset = item.baseOffset + extent.offset;
+            if (item.constructionMethod == 1) {
+                if (offset + extent.length > quint64(itemData.size()))
+                    return false;
+                xmp.append(itemData.constData() + offset, extent.length);
+            } else if (item.constructionMethod == 0) {
+                if (!device->seek(offset))
+                    return false;
+                const QByteArray chunk = device->read(extent.length);
+                if (chunk.size() != qint64(extent.length))
+                    return false;
+                xmp.append(chunk);
+            } else {
+                return false;
+            }
+        }
+
+        metaData = KDynamicWallpaperXmp::parse(xmp);
+        if (!metaData.isEmpty())
+            return true;
+    }
+
+    return false;
+}
+
+void KDynamicWallpaperInfoPrivate::setError(KDynamicWallpaperInfo::WallpaperInfoError error, const QString &text)
+{
+    wallpaperInfoError = error;
+    errorString = text;
+}
+
+bool KDynamicWallpaperInfoPrivate::open()
+{
+    if (!device) {
+        setError(KDynamicWallpaperInfo::OpenError, QStringLiteral("No assigned device"));
+        return false;
+    }
+
+    if (device->isOpen()) {
+        if (!(device->openMode() & QIODevice::ReadOnly)) {
+            setError(KDynamicWallpaperInfo::OpenError, QStringLiteral("The device is not open for reading"));
+            return false;
+        }
+    } else {
+        if (!device->open(QIODevice::ReadOnly)) {
+            setError(KDynamicWallpaperInfo::OpenError, device->errorString());
+            return false;
+        }
+    }
+
+    if (device->isSequential()) {
+        setError(KDynamicWallpaperInfo::OpenError, QStringLiteral("The device is sequential"));
+        return false;
+    }
+
+    bool hasFileType = false;
+    bool hasMeta = false;
+
+    const qint64 fileSize = device->size();
+    qint64 offset = 0;
+
+    while (offset < fileSize) {
+        if (!device->seek(offset)) {
+            setError(KDynamicWallpaperInfo::ReadError, device->errorString());
+            return false;
+        }
+
+        KDynamicWallpaperBox box;
+        if (!KDynamicWallpaperIsoBmff::parseBoxHeader(device->read(16), fileSize - offset, &box)) {
+            setError(KDynamicWallpaperInfo::ReadError, QStringLiteral("Malformed box header"));
+            return false;
+        }
+        box.offset = offset;
+
+        // Boxes that hold the image payloads, e.g. mdat, are skipped without being read.
+        if (box.type == fourcc("ftyp") || box.type == fourcc("meta") || box.type == fourcc("moov")) {
+            if (box.size > s_maxBoxSize) {
+                setError(KDynamicWallpaperInfo::ReadError, QStringLiteral("The box is too large"));
+                return false;
+            }
+
+            device->seek(offset + box.headerSize);
+            const QByteArray payload = device->read(box.size - box.headerSize);
+            if (payload.size() != box.size - box.headerSize) {
+                setError(KDynamicWallpaperInfo::ReadError, QStringLiteral("Unexpected end of file"));
+                return false;
+            }
+
+            if (box.type == fourcc("ftyp")) {
+                hasFileType = KDynamicWallpaperIsoBmff::isAvifFileType(payload);
+                if (!hasFileType) {
+                    setError(KDynamicWallpaperInfo::OpenError, QStringLiteral("Not an AVIF file"));
+                    return false;
+                }
+            } else if (box.type == fourcc("meta")) {
+                hasMeta = readMeta(payload);
+            } else if (!readMovie(payload)) {
+                setError(KDynamicWallpaperInfo::ReadError, QStringLiteral("Malformed movie box"));
+                return false;
+            }
+        } else if (!hasFileType) {
+            setError(KDynamicWallpaperInfo::OpenError, QStringLiteral("Not an AVIF file"));
+            return false;
+        } else if (box.type == fourcc("uuid") && metaData.isEmpty()) {
+            readMetaDataBox(box);
+        }
+
+        offset += box.size;
+    }
+
+    if (!hasMeta || !items.contains(primaryItemId)) {
+        setError(KDynamicWallpaperInfo::ReadError, QStringLiteral("No primary item"));
+        return false;
+    }
+
+    if (metaData.isEmpty() && !readMetaData()) {
+        setError(KDynamicWallpaperInfo::OpenError, QStringLiteral("No metadata"));
+        return false;
+    }
+
+    return true;
+}
+
+void KDynamicWallpaperInfoPrivate::close()
+{
+    if (!isDeviceForeign)
+        delete device;
+
+    device = nullptr;
+    isDeviceForeign = false;
+    wallpaperInfoError = KDynamicWallpaperInfo::NoError;
+    errorString.clear();
+    metaData.clear();
+    items.clear();
+    itemData.clear();
+    primaryItemId = 0;
+    trackSampleCount = -1;
+    trackSize = QSize();
+}
+
+/*!
+ * Constructs an empty KDynamicWallpaperInfo object.
+ */
+KDynamicWallpaperInfo::KDynamicWallpaperInfo()
+    : d(new KDynamicWallpaperInfoPrivate)
+{
+}
+
+/*!
+ * Constructs the KDynamicWallpaperInfo with the device \p device.
+ */
+KDynamicWallpaperInfo::KDynamicWallpaperInfo(QIODevice *device)
+    : d(new KDynamicWallpaperInfoPrivate)
+{
+    setDevice(device);
+}
+
+/*!
+ * Constructs the KDynamicWallpaperInfo with the file name \p fileName.
+ */
+KDynamicWallpaperInfo::KDynamicWallpaperInfo(const QString &fileName)
+    : d(new KDynamicWallpaperInfoPrivate)
+{
+    setFileName(fileName);
+}
+
+/*!
+ * Destructs the KDynamicWallpaperInfo object.
+ */
+KDynamicWallpaperInfo::~KDynamicWallpaperInfo()
+{
+    if (d->device)
+        d->close();
+}
+
+/*!
+ * Sets the device of the KDynamicWallpaperInfo to the specified \p device and inspects it.
+ *
+ * If the device is not already open, KDynamicWallpaperInfo will attempt to open the device
+ * in QIODevice::ReadOnly mode by calling open(). Sequential devices are not supported.
+ */
+void KDynamicWallpaperInfo::setDevice(QIODevice *device)
+{
+    if (d->device)
+        d->close();
+    d->device = device;
+    d->isDeviceForeign = true;
+    d->open();
+}
+
+/*!
+ * Returns the device assigned to the KDynamicWallpaperInfo, or \c nullptr if no device has
+ * been assigned.
+ */
+QIODevice *KDynamicWallpaperInfo::device() const
+{
+    return d->device;
+}
+
+/*!
+ * Sets the file name of the file to be inspected to \p fileName.
+ */
+void KDynamicWallpaperInfo::setFileName(const QString &fileName)
+{
+    if (d->device)
+        d->close();
+    d->device = new QFile(fileName);
+    d->isDeviceForeign = false;
+    d->open();
+}
+
+/*!
+ * If the currently assigned device is a QFile, or if setFileName() has been called, this
+ * function returns the name of the file KDynamicWallpaperInfo reads from; otherwise an empty
+ * QString object is returned.
+ */
+QString KDynamicWallpaperInfo::fileName() const
+{
+    const QFile *file = qobject_cast<QFile *>(d->device);
+    return file ? file->fileName() : QString();
+}
+
+/*!
+ * Returns the KDynamicWallpaperMetaData objects for the current wallpaper.
+ *
+ * \sa metaDataTable()
+ */
+QList<KDynamicWallpaperMetaData> KDynamicWallpaperInfo::metaData() const
+{
+    return d->metaData.toList();
+}
+
+/*!
+ * Returns the metadata of the current wallpaper as a table, without creating an object for
+ * every entry.
+ */
+KDynamicWallpaperMetaDataTable KDynamicWallpaperInfo::metaDataTable() const
+{
+    return d->metaData;
+}
+
+/*!
+ * Returns the total number of images in the dynamic wallpaper.
+ */
+int KDynamicWallpaperInfo::imageCount() const
+{
+    if (d->wallpaperInfoError != NoError)
+        return 0;
+    if (d->trackSampleCount != -1)
+        return d->trackSampleCount;
+    return 1;
+}
+
+/*!
+ * Returns the size of the image with the specified index \p imageIndex.
+ *
+ * This method will return an invalid QSize if \p imageIndex is outside of the valid range.
+ */
+QSize KDynamicWallpaperInfo::imageSize(int imageIndex) const
+{
+    if (imageIndex < 0 || imageIndex >= imageCount())
+        return QSize();
+
+    // All images in an image sequence share the dimensions of the primary item.
+    const QSize primarySize = d->items.value(d->primaryItemId).size;
+    if (primarySize.isValid())
+        return primarySize;
+    return d->trackSize;
+}
+
+/*!
+ * Returns the type of the last error that occurred.
+ */
+KDynamicWallpaperInfo::WallpaperInfoError KDynamicWallpaperInfo::error() const
+{
+    return d->wallpaperInfoError;
+}
+
+/*!
+ * Returns the human readable description of the last error that occurred.
+ */
+QString KDynamicWallpaperInfo::errorString() const
+{
+    if (d->wallpaperInfoError == NoError)
+        return QStringLiteral("No error");
+    return d->errorString;
+}
@@ -0,0 +1,49 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "kdynamicwallpaper_export.h"
+
+#include <QIODevice>
+#include <QSize>
+
+class KDynamicWallpaperMetaData;
+class KDynamicWallpaperMetaDataTable;
+class KDynamicWallpaperInfoPrivate;
+
+class KDYNAMICWALLPAPER_EXPORT KDynamicWallpaperInfo
+{
+public:
+    enum WallpaperInfoError {
+        NoError,
+        OpenError,
+        ReadError,
+    };
+
+    KDynamicWallpaperInfo();
+    explicit KDynamicWallpaperInfo(QIODevice *device);
+    explicit KDynamicWallpaperInfo(const QString &fileName);
+    ~KDynamicWallpaperInfo();
+
+    void setDevice(QIODevice *device);
+    QIODevice *device() const;
+
+    void setFileName(const QString &fileName);
+    QString fileName() const;
+
+    QList<KDynamicWallpaperMetaData> metaData() const;
+    KDynamicWallpaperMetaDataTable metaDataTable() const;
+
+    int imageCount() const;
+    QSize imageSize(int imageIndex) const;
+
+    WallpaperInfoError error() const;
+    QString errorString() const;
+
+private:
+    QScopedPointer<KDynamicWallpaperInfoPrivate> d;
+};
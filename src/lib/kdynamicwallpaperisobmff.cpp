@@ -0,0 +1,1149 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "kdynamicwallpaperisobmff_p.h"
+
+#include <QDataStream>
+#include <QtEndian>
+
+#include <algorithm>
+#include <initializer_list>
+#include <limits>
+
+/*!
+ * \internal
+ * \class KDynamicWallpaperIsoBmff
+ * \brief The KDynamicWallpaperIsoBmff class provides helpers for parsing and patching the ISO base
+ * media file format boxes that AVIF files are made of.
+ */
+
+/*!
+ * \internal
+ *
+ * Parses the header of the box that starts at the beginning of \p data. \p available specifies
+ * the number of bytes left in the enclosing box or file.
+ */
+bool KDynamicWallpaperIsoBmff::parseBoxHeader(const QByteArray &data, qint64 available, KDynamicWallpaperBox *box)
+{
+    if (data.size() < 8)
+        return false;
+
+    const uchar *header = reinterpret_cast<const uchar *>(data.constData());
+    quint64 size = qFromBigEndian<quint32>(header);
+    box->type = qFromBigEndian<quint32>(header + 4);
+    box->headerSize = 8;
+
+    if (size == 1) {
+        if (data.size() < 16)
+            return false;
+        size = qFromBigEndian<quint64>(header + 8);
+        box->headerSize = 16;
+    } else if (size == 0) {
+        size = available;
+    }
+
+    if (size < quint64(box->headerSize) || size > quint64(available))
+        return false;
+
+    box->size = size;
+    return true;
+}
+
+/*!
+ * \internal
+ *
+ * Splits the specified \p data into a list of boxes. The offsets of the returned boxes are
+ * relative to the start of \p data.
+ */
+QVector<KDynamicWallpaperBox> KDynamicWallpaperIsoBmff::parseBoxes(const QByteArray &data, int offset)
+{
+    QVector<KDynamicWallpaperBox> boxes;
+
+    while (offset < data.size()) {
+        KDynamicWallpaperBox box;
+        const QByteArray header = QByteArray::fromRawData(data.constData() + offset,
+                                                          std::min(16, data.size() - offset));
+        if (!parseBoxHeader(header, data.size() - offset, &box))
+            break;
+        box.offset = offset;
+        boxes.append(box);
+        offset += box.size;
+    }
+
+    return boxes;
+}
+
+QByteArray KDynamicWallpaperIsoBmff::boxPayload(const QByteArray &data, const KDynamicWallpaperBox &box)
+{
+    return QByteArray::fromRawData(data.constData() + box.offset + box.headerSize,
+                                   box.size - box.headerSize);
+}
+
+quint64 KDynamicWallpaperIsoBmff::readVariableSizeInteger(QDataStream &stream, int size)
+{
+    switch (size) {
+    case 0:
+        return 0;
+    case 4: {
+        quint32 value;
+        stream >> value;
+        return value;
+    }
+    case 8: {
+        quint64 value;
+        stream >> value;
+        return value;
+    }
+    default:
+        stream.setStatus(QDataStream::ReadCorruptData);
+        return 0;
+    }
+}
+
+bool KDynamicWallpaperIsoBmff::isAvifFileType(const QByteArray &payload)
+{
+    // The major brand and the compatible brands are interleaved with the minor version, which
+    // is fine since the minor version is never going to look like a brand we are looking for.
+    for (int i = 0; i + 4 <= payload.size(); i += 4) {
+        const quint32 brand = qFromBigEndian<quint32>(payload.constData() + i);
+        if (brand == fourcc("avif") || brand == fourcc("avis"))
+            return true;
+    }
+    return false;
+}
+
+void KDynamicWallpaperIsoBmff::readItemInfo(const QByteArray &payload, QHash<quint32, KDynamicWallpaperItem> *items)
+{
+    QDataStream stream(payload);
+
+    quint8 version;
+    stream >> version;
+    stream.skipRawData(3);
+
+    int offset = version == 0 ? 6 : 8;
+    const QVector<KDynamicWallpaperBox> entries = parseBoxes(payload, offset);
+    for (const KDynamicWallpaperBox &entry : entries) {
+        if (entry.type != fourcc("infe"))
+            continue;
+
+        QDataStream entryStream(boxPayload(payload, entry));
+        quint8 entryVersion;
+        entryStream >> entryVersion;
+        entryStream.skipRawData(3);
+        if (entryVersion < 2)
+            continue;
+
+        quint32 itemId;
+        if (entryVersion == 2) {
+            quint16 shortItemId;
+            entryStream >> shortItemId;
+            itemId = shortItemId;
+        } else {
+            entryStream >> itemId;
+        }
+
+        quint16 protectionIndex;
+        quint32 itemType;
+        entryStream >> protectionIndex >> itemType;
+        if (entryStream.status() != QDataStream::Ok)
+            continue;
+
+        KDynamicWallpaperItem &item = (*items)[itemId];
+        item.type = itemType;
+
+        if (itemType == fourcc("mime")) {
+            // The item name is followed by the content type, both are null-terminated.
+            const QByteArray rest = boxPayload(payload, entry).mid(entryVersion == 2 ? 12 : 14);
+            const QList<QByteArray> strings = rest.split('\0');
+            if (strings.count() > 1)
+                item.contentType = strings[1];
+        }
+    }
+}
+
+bool KDynamicWallpaperIsoBmff::readItemLocations(const QByteArray &payload, QHash<quint32, KDynamicWallpaperItem> *items)
+{
+    QDataStream stream(payload);
+
+    quint8 version, sizes1, sizes2;
+    stream >> version;
+    stream.skipRawData(3);
+    stream >> sizes1 >> sizes2;
+
+    const int offsetSize = sizes1 >> 4;
+    const int lengthSize = sizes1 & 0xf;
+    const int baseOffsetSize = sizes2 >> 4;
+    const int indexSize = (version == 1 || version == 2) ? (sizes2 & 0xf) : 0;
+
+    quint32 itemCount;
+    if (version < 2) {
+        quint16 shortItemCount;
+        stream >> shortItemCount;
+        itemCount = shortItemCount;
+    } else {
+        stream >> itemCount;
+    }
+
+    for (quint32 i = 0; i < itemCount && stream.status() == QDataStream::Ok; ++i) {
+        quint32 itemId;
+        if (version < 2) {
+            quint16 shortItemId;
+            stream >> shortItemId;
+            itemId = shortItemId;
+        } else {
+            stream >> itemId;
+        }
+
+        int constructionMethod = 0;
+        if (version == 1 || version == 2) {
+            quint16 value;
+            stream >> value;
+            constructionMethod = value & 0xf;
+        }
+
+        quint16 dataReferenceIndex;
+        stream >> dataReferenceIndex;
+
+        KDynamicWallpaperItem &item = (*items)[itemId];
+        item.constructionMethod = constructionMethod;
+        item.baseOffset = readVariableSizeInteger(stream, baseOffsetSize);
+
+        quint16 extentCount;
+        stream >> extentCount;
+        item.extents.resize(extentCount);
+
+        for (KDynamicWallpaperItemExtent &extent : item.extents) {
+            readVariableSizeInteger(stream, indexSize);
+            extent.offsetField = { int(stream.device()->pos()), offsetSize };
+            extent.offset = readVariableSizeInteger(stream, offsetSize);
+            extent.lengthField = { int(stream.device()->pos()), lengthSize };
+            extent.length = readVariableSizeInteger(stream, lengthSize);
+        }
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+void KDynamicWallpaperIsoBmff::readItemProperties(const QByteArray &payload, QHash<quint32, KDynamicWallpaperItem> *items)
+{
+    QVector<QSize> properties;
+
+    const QVector<KDynamicWallpaperBox> boxes = parseBoxes(payload);
+    for (const KDynamicWallpaperBox &box : boxes) {
+        if (box.type == fourcc("ipco")) {
+            const QByteArray container = boxPayload(payload, box);
+            const QVector<KDynamicWallpaperBox> children = parseBoxes(container);
+            for (const KDynamicWallpaperBox &child : children) {
+                // Properties other than the spatial extents are not interesting to us, but
+                // they still have to occupy their slot because associations are index-based.
+                QSize size;
+                if (child.type == fourcc("ispe")) {
+                    QDataStream stream(boxPayload(container, child));
+                    quint32 width, height;
+                    stream.skipRawData(4);
+                    stream >> width >> height;
+                    if (stream.status() == QDataStream::Ok)
+                        size = QSize(width, height);
+                }
+                properties.append(size);
+            }
+        } else if (box.type == fourcc("ipma")) {
+            QDataStream stream(boxPayload(payload, box));
+
+            quint8 version;
+            quint8 flags[3];
+            stream >> version >> flags[0] >> flags[1] >> flags[2];
+
+            quint32 entryCount;
+            stream >> entryCount;
+
+            for (quint32 i = 0; i < entryCount && stream.status() == QDataStream::Ok; ++i) {
+                quint32 itemId;
+                if (version < 1) {
+                    quint16 shortItemId;
+                    stream >> shortItemId;
+                    itemId = shortItemId;
+                } else {
+                    stream >> itemId;
+                }
+
+                quint8 associationCount;
+                stream >> associationCount;
+
+                for (int j = 0; j < associationCount; ++j) {
+                    int propertyIndex;
+                    if (flags[2] & 1) {
+                        quint16 value;
+                        stream >> value;
+                        propertyIndex = value & 0x7fff;
+                    } else {
+                        quint8 value;
+                        stream >> value;
+                        propertyIndex = value & 0x7f;
+                    }
+
+                    // Property indices are 1-based, 0 means no property.
+                    const QSize size = properties.value(propertyIndex - 1);
+                    if (size.isValid() && items->contains(itemId))
+                        (*items)[itemId].size = size;
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \internal
+ *
+ * Returns the child boxes of the specified \p parent box in \p file. The offsets of the returned
+ * boxes are relative to the start of the file.
+ */
+static QVector<KDynamicWallpaperBox> parseChildren(const QByteArray &file, const KDynamicWallpaperBox &parent)
+{
+    const QByteArray payload = KDynamicWallpaperIsoBmff::boxPayload(file, parent);
+    QVector<KDynamicWallpaperBox> children = KDynamicWallpaperIsoBmff::parseBoxes(payload);
+    for (KDynamicWallpaperBox &child : children)
+        child.offset += parent.offset + parent.headerSize;
+    return children;
+}
+
+static bool findChild(const QByteArray &file, const KDynamicWallpaperBox &parent, quint32 type, KDynamicWallpaperBox *child)
+{
+    const QVector<KDynamicWallpaperBox> children = parseChildren(file, parent);
+    const KDynamicWallpaperBox *box = KDynamicWallpaperIsoBmff::findBox(children, type);
+    if (!box)
+        return false;
+    *child = *box;
+    return true;
+}
+
+class KDynamicWallpaperTrack
+{
+public:
+    KDynamicWallpaperBox moov;
+    KDynamicWallpaperBox trak;
+    KDynamicWallpaperBox mdia;
+    KDynamicWallpaperBox minf;
+    KDynamicWallpaperBox stbl;
+};
+
+/*!
+ * \internal
+ *
+ * Finds the boxes that lead to the sample table of the image sequence in the specified \p file.
+ * Only image sequences with a single track are supported, e.g. there must be no alpha track.
+ */
+static bool findTrack(const QByteArray &file, KDynamicWallpaperTrack *track)
+{
+    const QVector<KDynamicWallpaperBox> boxes = KDynamicWallpaperIsoBmff::parseBoxes(file);
+    const KDynamicWallpaperBox *moov = KDynamicWallpaperIsoBmff::findBox(boxes, fourcc("moov"));
+    if (!moov)
+        return false;
+    track->moov = *moov;
+
+    int trackCount = 0;
+    const QVector<KDynamicWallpaperBox> moovBoxes = parseChildren(file, *moov);
+    for (const KDynamicWallpaperBox &box : moovBoxes) {
+        if (box.type == fourcc("trak")) {
+            track->trak = box;
+            trackCount++;
+        }
+    }
+    if (trackCount != 1)
+        return false;
+
+    return findChild(file, track->trak, fourcc("mdia"), &track->mdia) &&
+        findChild(file, track->mdia, fourcc("minf"), &track->minf) &&
+        findChild(file, track->minf, fourcc("stbl"), &track->stbl);
+}
+
+// Downscaled renditions of the images are stored as complete AVIF files in uuid boxes at the
+// end of the file. Readers that don't know about them skip the boxes.
+static const char s_renditionUuid[16] = {
+    '\x5b', '\x0e', '\x8c', '\x2d', '\x41', '\x7f', '\x4a', '\x93',
+    '\xb6', '\x1d', '\x60', '\x2c', '\xd8', '\x3e', '\x95', '\x47',
+};
+
+static QByteArray makeBox(quint32 type, const QByteArray &payload);
+
+/*!
+ * \internal
+ *
+ * Returns a box that contains the AVIF \p file with \p imageCount images of the given \p size,
+ * which is a rendition of the images in the enclosing file.
+ */
+QByteArray KDynamicWallpaperIsoBmff::makeRendition(const QSize &size, int imageCount, const QByteArray &file)
+{
+    return makeRenditionHeader(size, imageCount, file.size()) + file;
+}
+
+/*!
+ * \internal
+ *
+ * Returns the beginning of a rendition box, up to the AVIF file of \p fileSize bytes that must
+ * follow it. This allows writing the file without copying it into the box first.
+ */
+QByteArray KDynamicWallpaperIsoBmff::makeRenditionHeader(const QSize &size, int imageCount, qint64 fileSize)
+{
+    QByteArray header(8, Qt::Uninitialized);
+    qToBigEndian<quint32>(8 + renditionHeaderSize + fileSize, header.data());
+    qToBigEndian<quint32>(fourcc("uuid"), header.data() + 4);
+    header.append(s_renditionUuid, sizeof(s_renditionUuid));
+
+    QDataStream stream(&header, QIODevice::WriteOnly | QIODevice::Append);
+    stream << quint32(size.width()) << quint32(size.height()) << quint32(imageCount);
+    return header;
+}
+
+/*!
+ * \internal
+ *
+ * Parses the first renditionHeaderSize bytes of the payload of the specified \p box. Returns
+ * \c false if the box doesn't contain a rendition. The offset of the rendition is relative to
+ * the start of the file that contains the box.
+ */
+bool KDynamicWallpaperIsoBmff::readRenditionHeader(const QByteArray &header, const KDynamicWallpaperBox &box,
+                                                   KDynamicWallpaperRendition *rendition)
+{
+    if (box.type != fourcc("uuid") || header.size() < renditionHeaderSize)
+        return false;
+    if (box.size - box.headerSize <= renditionHeaderSize)
+        return false;
+    if (!header.startsWith(QByteArray::fromRawData(s_renditionUuid, sizeof(s_renditionUuid))))
+        return false;
+
+    QDataStream stream(header);
+    stream.skipRawData(sizeof(s_renditionUuid));
+
+    quint32 width, height, imageCount;
+    stream >> width >> height >> imageCount;
+    if (!width || !height || width > quint32(std::numeric_limits<int>::max()) || height > quint32(std::numeric_limits<int>::max())
+        || imageCount > quint32(std::numeric_limits<int>::max()))
+        return false;
+
+    rendition->size = QSize(width, height);
+    rendition->imageCount = imageCount;
+    rendition->offset = box.offset + box.headerSize + renditionHeaderSize;
+    rendition->length = box.size - box.headerSize - renditionHeaderSize;
+    return true;
+}
+
+// The binary copy of the dynamic wallpaper metadata is stored in a uuid box at the end of the
+// file as well. It's much quicker to parse than the XMP packet, which is kept for compatibility.
+static const char s_metaDataUuid[16] = {
+    '\x2a', '\x9b', '\x51', '\xe4', '\x0c', '\x6d', '\x4f', '\x38',
+    '\x8e', '\x27', '\xd1', '\x93', '\x4a', '\x70', '\xbc', '\x15',
+};
+
+/*!
+ * \internal
+ *
+ * Returns a box that contains the binary dynamic wallpaper metadata block \p cbor.
+ */
+QByteArray KDynamicWallpaperIsoBmff::makeMetaDataBox(const QByteArray &cbor)
+{
+    return makeBox(fourcc("uuid"), QByteArray(s_metaDataUuid, sizeof(s_metaDataUuid)) + cbor);
+}
+
+/*!
+ * \internal
+ *
+ * Returns \c true if the specified \p box contains the binary dynamic wallpaper metadata.
+ * \p header must contain at least the first metaDataHeaderSize bytes of the box payload. The
+ * metadata block starts right after them.
+ */
+bool KDynamicWallpaperIsoBmff::isMetaDataBox(const QByteArray &header, const KDynamicWallpaperBox &box)
+{
+    if (box.type != fourcc("uuid") || box.size - box.headerSize < metaDataHeaderSize)
+        return false;
+    return header.startsWith(QByteArray::fromRawData(s_metaDataUuid, sizeof(s_metaDataUuid)));
+}
+
+/*!
+ * \internal
+ *
+ * Replaces the binary dynamic wallpaper metadata in the specified in-memory AVIF \p file with
+ * \p cbor. The new metadata box is appended to the file.
+ *
+ * An old metadata box at the end of the file is cut off, other old metadata boxes are turned
+ * into free boxes so the boxes that follow them, e.g. an mdat box with the XMP packet, don't
+ * move.
+ */
+void KDynamicWallpaperIsoBmff::replaceMetaDataBox(QByteArray *file, const QByteArray &cbor)
+{
+    qint64 fileSize = file->size();
+
+    const QVector<KDynamicWallpaperBox> boxes = parseBoxes(*file);
+    for (auto it = boxes.crbegin(); it != boxes.crend(); ++it) {
+        if (!isMetaDataBox(boxPayload(*file, *it).left(metaDataHeaderSize), *it))
+            continue;
+        if (it->offset + it->size == fileSize)
+            fileSize = it->offset;
+        else
+            qToBigEndian<quint32>(fourcc("free"), file->data() + it->offset + 4);
+    }
+
+    file->truncate(fileSize);
+    file->append(makeMetaDataBox(cbor));
+}
+
+/*!
+ * \internal
+ *
+ * Reads the sample table of the image sequence in the specified in-memory AVIF \p file. Returns
+ * \c false if the file is not an image sequence or the sample table is malformed.
+ */
+bool KDynamicWallpaperIsoBmff::readSamples(const QByteArray &file, QVector<KDynamicWallpaperSample> *samples)
+{
+    struct ChunkRun
+    {
+        quint32 firstChunk;
+        quint32 samplesPerChunk;
+    };
+
+    KDynamicWallpaperTrack track;
+    if (!findTrack(file, &track))
+        return false;
+
+    QVector<quint32> sampleSizes;
+    QVector<quint64> chunkOffsets;
+    QVector<ChunkRun> chunkRuns;
+    QVector<quint32> durations;
+    QVector<quint32> syncSamples;
+    bool hasSyncSamples = false;
+
+    // Every table entry takes at least four bytes, which puts an upper bound on the entry count.
+    const quint32 maxEntryCount = file.size() / 4;
+
+    const QVector<KDynamicWallpaperBox> tables = parseChildren(file, track.stbl);
+    for (const KDynamicWallpaperBox &table : tables) {
+        QDataStream stream(boxPayload(file, table));
+        stream.skipRawData(4);
+
+        switch (table.type) {
+        case fourcc("stsz"): {
+            quint32 sampleSize, sampleCount;
+            stream >> sampleSize >> sampleCount;
+            if (sampleCount > maxEntryCount)
+                return false;
+            for (quint32 i = 0; i < sampleCount && stream.status() == QDataStream::Ok; ++i) {
+                quint32 size = sampleSize;
+                if (!sampleSize)
+                    stream >> size;
+                sampleSizes.append(size);
+            }
+            break;
+        }
+        case fourcc("stco"):
+        case fourcc("co64"): {
+            quint32 entryCount;
+            stream >> entryCount;
+            if (entryCount > maxEntryCount)
+                return false;
+            for (quint32 i = 0; i < entryCount && stream.status() == QDataStream::Ok; ++i)
+                chunkOffsets.append(readVariableSizeInteger(stream, table.type == fourcc("stco") ? 4 : 8));
+            break;
+        }
+        case fourcc("stsc"): {
+            quint32 entryCount;
+            stream >> entryCount;
+            if (entryCount > maxEntryCount)
+                return false;
+            for (quint32 i = 0; i < entryCount && stream.status() == QDataStream::Ok; ++i) {
+                quint32 firstChunk, samplesPerChunk, sampleDescriptionIndex;
+                stream >> firstChunk >> samplesPerChunk >> sampleDescriptionIndex;
+                chunkRuns.append({ firstChunk, samplesPerChunk });
+            }
+            break;
+        }
+        case fourcc("stts"): {
+            quint32 entryCount;
+            stream >> entryCount;
+            if (entryCount > maxEntryCount)
+                return false;
+            for (quint32 i = 0; i < entryCount && stream.status() == QDataStream::Ok; ++i) {
+                quint32 sampleCount, sampleDelta;
+                stream >> sampleCount >> sampleDelta;
+                if (sampleCount > maxEntryCount - durations.count())
+                    return false;
+                durations.insert(durations.count(), sampleCount, sampleDelta);
+            }
+            break;
+        }
+        case fourcc("stss"): {
+            quint32 entryCount;
+            stream >> entryCount;
+            if (entryCount > maxEntryCount)
+                return false;
+            for (quint32 i = 0; i < entryCount && stream.status() == QDataStream::Ok; ++i) {
+                quint32 sampleNumber;
+                stream >> sampleNumber;
+                syncSamples.append(sampleNumber);
+            }
+            hasSyncSamples = true;
+            break;
+        }
+        default:
+            continue;
+        }
+
+        if (stream.status() != QDataStream::Ok)
+            return false;
+    }
+
+    if (sampleSizes.isEmpty() || durations.count() != sampleSizes.count())
+        return false;
+
+    samples->clear();
+    samples->reserve(sampleSizes.count());
+
+    for (int run = 0; run < chunkRuns.count(); ++run) {
+        const quint32 firstChunk = chunkRuns[run].firstChunk;
+        const quint32 lastChunk = run + 1 < chunkRuns.count() ? chunkRuns[run + 1].firstChunk : chunkOffsets.count() + 1;
+        if (firstChunk < 1 || lastChunk < firstChunk || lastChunk > quint32(chunkOffsets.count()) + 1)
+            return false;
+
+        for (quint32 chunk = firstChunk; chunk < lastChunk; ++chunk) {
+            quint64 offset = chunkOffsets[chunk - 1];
+            for (quint32 i = 0; i < chunkRuns[run].samplesPerChunk; ++i) {
+                const int sampleIndex = samples->count();
+                if (sampleIndex >= sampleSizes.count())
+                    return false;
+
+                KDynamicWallpaperSample sample;
+                sample.offset = offset;
+                sample.size = sampleSizes[sampleIndex];
+                sample.duration = durations[sampleIndex];
+                sample.isSyncSample = !hasSyncSamples;
+                if (sample.offset + sample.size > quint64(file.size()))
+                    return false;
+
+                samples->append(sample);
+                offset += sample.size;
+            }
+        }
+    }
+
+    if (samples->count() != sampleSizes.count())
+        return false;
+
+    // Sample numbers are 1-based. If there is no sync sample table, every sample is a sync sample.
+    for (quint32 sampleNumber : qAsConst(syncSamples)) {
+        if (sampleNumber < 1 || sampleNumber > quint32(samples->count()))
+            return false;
+        (*samples)[sampleNumber - 1].isSyncSample = true;
+    }
+
+    return true;
+}
+
+const KDynamicWallpaperBox *KDynamicWallpaperIsoBmff::findBox(const QVector<KDynamicWallpaperBox> &boxes, quint32 type)
+{
+    for (const KDynamicWallpaperBox &box : boxes) {
+        if (box.type == type)
+            return &box;
+    }
+    return nullptr;
+}
+
+/*!
+ * \internal
+ *
+ * Returns all meta boxes in the specified \p file, i.e. the meta box at the top level and the
+ * meta boxes of the tracks in the movie box. The offsets of the returned boxes are relative to
+ * the start of the file.
+ */
+static QVector<KDynamicWallpaperBox> findMetaBoxes(const QByteArray &file)
+{
+    QVector<KDynamicWallpaperBox> metaBoxes;
+
+    const QVector<KDynamicWallpaperBox> boxes = KDynamicWallpaperIsoBmff::parseBoxes(file);
+    for (const KDynamicWallpaperBox &box : boxes) {
+        if (box.type == fourcc("meta")) {
+            metaBoxes.append(box);
+        } else if (box.type == fourcc("moov")) {
+            const QByteArray moovData = KDynamicWallpaperIsoBmff::boxPayload(file, box);
+            const QVector<KDynamicWallpaperBox> tracks = KDynamicWallpaperIsoBmff::parseBoxes(moovData);
+            for (const KDynamicWallpaperBox &trak : tracks) {
+                if (trak.type != fourcc("trak"))
+                    continue;
+
+                const QByteArray trakData = KDynamicWallpaperIsoBmff::boxPayload(moovData, trak);
+                const QVector<KDynamicWallpaperBox> trakBoxes = KDynamicWallpaperIsoBmff::parseBoxes(trakData);
+                const KDynamicWallpaperBox *meta = KDynamicWallpaperIsoBmff::findBox(trakBoxes, fourcc("meta"));
+                if (!meta)
+                    continue;
+
+                KDynamicWallpaperBox metaBox = *meta;
+                metaBox.offset += box.offset + box.headerSize + trak.offset + trak.headerSize;
+                metaBoxes.append(metaBox);
+            }
+        }
+    }
+
+    return metaBoxes;
+}
+
+static bool writeVariableSizeInteger(char *file, qint64 position, const KDynamicWallpaperField &field, quint64 value)
+{
+    uchar *data = reinterpret_cast<uchar *>(file) + position;
+    switch (field.size) {
+    case 0:
+        return value == 0;
+    case 4:
+        if (value > std::numeric_limits<quint32>::max())
+            return false;
+        qToBigEndian<quint32>(value, data);
+        return true;
+    case 8:
+        qToBigEndian<quint64>(value, data);
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*!
+ * Replaces the XMP packets in the specified in-memory AVIF \p file with \p xmp.
+ *
+ * If the new packet fits in place of the old one, it is overwritten; otherwise the new packet
+ * is appended to the file in a new mdat box and the item locations are pointed at it. Either
+ * way, no other box changes its size or position, so the image payloads stay untouched.
+ *
+ * Returns \c false if the file contains no XMP item or the item cannot be relocated.
+ */
+bool KDynamicWallpaperIsoBmff::replaceMetaData(QByteArray *file, const QByteArray &xmp)
+{
+    QByteArray appendix;
+    if (!replaceMetaData(file->data(), file->size(), file->size(), xmp, &appendix))
+        return false;
+    file->append(appendix);
+    return true;
+}
+
+/*!
+ * \internal
+ *
+ * Replaces the XMP packets in the AVIF file of \p fileSize bytes at \p file in place. If the new
+ * packet doesn't fit in place of the old one, the mdat box with the new packet is stored in
+ * \p appendix, and the caller must write it \p appendOffset bytes into the output file, i.e.
+ * after anything else that follows the AVIF file.
+ */
+bool KDynamicWallpaperIsoBmff::replaceMetaData(char *file, int fileSize, qint64 appendOffset,
+                                               const QByteArray &xmp, QByteArray *appendix)
+{
+    struct Location
+    {
+        qint64 position;
+        KDynamicWallpaperItem item;
+    };
+
+    QVector<Location> locations;
+
+    const QByteArray view = QByteArray::fromRawData(file, fileSize);
+    const QVector<KDynamicWallpaperBox> metaBoxes = findMetaBoxes(view);
+    for (const KDynamicWallpaperBox &metaBox : metaBoxes) {
+        const qint64 metaOffset = metaBox.offset + metaBox.headerSize;
+        const QByteArray payload = boxPayload(view, metaBox);
+
+        // The meta box is a full box, skip the version and the flags.
+        const QVector<KDynamicWallpaperBox> boxes = parseBoxes(payload, 4);
+        QHash<quint32, KDynamicWallpaperItem> items;
+        if (const KDynamicWallpaperBox *iinf = findBox(boxes, fourcc("iinf")))
+            readItemInfo(boxPayload(payload, *iinf), &items);
+
+        const KDynamicWallpaperBox *iloc = findBox(boxes, fourcc("iloc"));
+        if (!iloc || !readItemLocations(boxPayload(payload, *iloc), &items))
+            continue;
+
+        for (const KDynamicWallpaperItem &item : qAsConst(items)) {
+            if (item.type != fourcc("mime") || item.contentType != QByteArrayLiteral("application/rdf+xml"))
+                continue;
+            if (item.constructionMethod != 0 || item.extents.count() != 1)
+                return false;
+            locations.append({ metaOffset + iloc->offset + iloc->headerSize, item });
+        }
+    }
+
+    if (locations.isEmpty())
+        return false;
+
+    // All XMP items usually share the same bytes, overwrite them if the new packet fits.
+    const KDynamicWallpaperItem &firstItem = locations.first().item;
+    const quint64 oldOffset = firstItem.baseOffset + firstItem.extents.first().offset;
+    quint64 capacity = firstItem.extents.first().length;
+    for (const Location &location : qAsConst(locations)) {
+        const KDynamicWallpaperItem &item = location.item;
+        if (item.baseOffset + item.extents.first().offset != oldOffset)
+            capacity = 0;
+    }
+
+    quint64 newOffset = oldOffset;
+    if (quint64(xmp.size()) <= capacity && oldOffset + capacity <= quint64(fileSize)) {
+        std::copy(xmp.constBegin(), xmp.constEnd(), file + oldOffset);
+    } else {
+        *appendix = makeBox(fourcc("mdat"), xmp);
+        newOffset = appendOffset + 8;
+    }
+
+    for (const Location &location : qAsConst(locations)) {
+        const KDynamicWallpaperItem &item = location.item;
+        const KDynamicWallpaperItemExtent &extent = item.extents.first();
+        if (newOffset < item.baseOffset)
+            return false;
+        if (!writeVariableSizeInteger(file, location.position + extent.offsetField.position, extent.offsetField, newOffset - item.baseOffset))
+            return false;
+        if (!writeVariableSizeInteger(file, location.position + extent.lengthField.position, extent.lengthField, xmp.size()))
+            return false;
+    }
+
+    return true;
+}
+
+static QByteArray makeBox(quint32 type, const QByteArray &payload)
+{
+    QByteArray box(8, Qt::Uninitialized);
+    qToBigEndian<quint32>(8 + payload.size(), box.data());
+    qToBigEndian<quint32>(type, box.data() + 4);
+    return box + payload;
+}
+
+/*!
+ * \internal
+ *
+ * Returns a version 0 full box that contains the specified 32-bit \p fields followed by the
+ * table \p entries.
+ */
+static QByteArray makeFullBox(quint32 type, std::initializer_list<quint32> fields, const QByteArray &entries = QByteArray())
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream << quint32(0);
+    for (quint32 field : fields)
+        stream << field;
+    return makeBox(type, payload + entries);
+}
+
+/*!
+ * \internal
+ *
+ * Returns a copy of the specified \p box in \p file with the children whose types are listed in
+ * \p replacements replaced. Children that are replaced with an empty byte array are dropped.
+ */
+static QByteArray rebuildBox(const QByteArray &file, const KDynamicWallpaperBox &box,
+                             const QHash<quint32, QByteArray> &replacements)
+{
+    QByteArray payload;
+
+    const QVector<KDynamicWallpaperBox> children = parseChildren(file, box);
+    for (const KDynamicWallpaperBox &child : children) {
+        if (replacements.contains(child.type))
+            payload += replacements.value(child.type);
+        else
+            payload += file.mid(child.offset, child.size);
+    }
+
+    return makeBox(box.type, payload);
+}
+
+/*!
+ * \internal
+ *
+ * Returns the timescale stored in the specified movie or media header \p box, or \c 0 if the box
+ * is malformed.
+ */
+static quint32 readTimescale(const QByteArray &file, const KDynamicWallpaperBox &box)
+{
+    QDataStream stream(KDynamicWallpaperIsoBmff::boxPayload(file, box));
+
+    quint8 version;
+    stream >> version;
+    stream.skipRawData(version == 1 ? 19 : 11);
+
+    quint32 timescale;
+    stream >> timescale;
+    return stream.status() == QDataStream::Ok ? timescale : 0;
+}
+
+/*!
+ * \internal
+ *
+ * Returns a copy of the specified header \p box with its duration set to \p duration. The
+ * duration field starts \p offset0 or \p offset1 bytes into the payload of a version 0 and a
+ * version 1 box, respectively. An empty byte array is returned if the duration doesn't fit.
+ */
+static QByteArray patchDuration(const QByteArray &file, const KDynamicWallpaperBox &box,
+                                int offset0, int offset1, quint64 duration)
+{
+    QByteArray data = file.mid(box.offset, box.size);
+    uchar *payload = reinterpret_cast<uchar *>(data.data()) + box.headerSize;
+    const qint64 payloadSize = box.size - box.headerSize;
+    if (payloadSize < 1)
+        return QByteArray();
+
+    if (payload[0] == 1) {
+        if (offset1 + 8 > payloadSize)
+            return QByteArray();
+        qToBigEndian<quint64>(duration, payload + offset1);
+    } else {
+        if (offset0 + 4 > payloadSize || duration > std::numeric_limits<quint32>::max())
+            return QByteArray();
+        qToBigEndian<quint32>(duration, payload + offset0);
+    }
+
+    return data;
+}
+
+/*!
+ * Builds a new AVIF file in \p output that contains the samples with the specified
+ * \p sampleIndices from the image sequence in \p file, in that order, and the XMP packet \p xmp.
+ *
+ * The compressed samples are copied byte-for-byte, so the caller must make sure that every
+ * sample that is not a sync sample is preceded by the samples it depends on. The primary item
+ * is pointed at the first sample, other items that are stored in the file are carried over.
+ *
+ * Renditions of the image sequence are remuxed along with it. If \p xmp is empty, the file
+ * doesn't need to contain an XMP item.
+ *
+ * Returns \c false if the file is not an image sequence with a single track or it can't be
+ * remuxed.
+ */
+bool KDynamicWallpaperIsoBmff::remux(const QByteArray &file, const QVector<int> &sampleIndices,
+                                     const QByteArray &xmp, QByteArray *output)
+{
+    struct Patch
+    {
+        qint64 position;
+        KDynamicWallpaperField field;
+        quint64 value;
+        bool isRelative;
+    };
+
+    KDynamicWallpaperTrack track;
+    QVector<KDynamicWallpaperSample> samples;
+    if (sampleIndices.isEmpty() || !findTrack(file, &track) || !readSamples(file, &samples))
+        return false;
+
+    QByteArray media;
+    QByteArray timeToSample;
+    QByteArray sampleSizes;
+    QByteArray syncSamples;
+    QDataStream sizeStream(&sampleSizes, QIODevice::WriteOnly);
+    QDataStream syncStream(&syncSamples, QIODevice::WriteOnly);
+    QVector<QPair<quint32, quint32>> timeRuns;
+    quint32 syncSampleCount = 0;
+    quint64 mediaDuration = 0;
+
+    for (int i = 0; i < sampleIndices.count(); ++i) {
+        if (sampleIndices[i] < 0 || sampleIndices[i] >= samples.count())
+            return false;
+
+        const KDynamicWallpaperSample &sample = samples[sampleIndices[i]];
+        media.append(file.constData() + sample.offset, sample.size);
+        sizeStream << sample.size;
+        mediaDuration += sample.duration;
+
+        if (!timeRuns.isEmpty() && timeRuns.last().second == sample.duration)
+            timeRuns.last().first++;
+        else
+            timeRuns.append({ 1, sample.duration });
+
+        if (sample.isSyncSample) {
+            syncStream << quint32(i + 1);
+            syncSampleCount++;
+        }
+    }
+
+    QDataStream timeStream(&timeToSample, QIODevice::WriteOnly);
+    for (const auto &timeRun : qAsConst(timeRuns))
+        timeStream << timeRun.first << timeRun.second;
+
+    const QVector<KDynamicWallpaperBox> tables = parseChildren(file, track.stbl);
+    const KDynamicWallpaperBox *stsd = findBox(tables, fourcc("stsd"));
+    if (!stsd)
+        return false;
+
+    // All samples go to a single chunk. The chunk offset is filled in once the layout is known.
+    QByteArray sampleTable = file.mid(stsd->offset, stsd->size);
+    sampleTable += makeFullBox(fourcc("stts"), { quint32(timeRuns.count()) }, timeToSample);
+    sampleTable += makeFullBox(fourcc("stsc"), { 1, 1, quint32(sampleIndices.count()), 1 });
+    sampleTable += makeFullBox(fourcc("stsz"), { 0, quint32(sampleIndices.count()) }, sampleSizes);
+    sampleTable += makeFullBox(fourcc("stco"), { 1, 0 });
+    sampleTable += makeFullBox(fourcc("stss"), { syncSampleCount }, syncSamples);
+
+    KDynamicWallpaperBox mvhd, tkhd, mdhd;
+    if (!findChild(file, track.moov, fourcc("mvhd"), &mvhd) ||
+            !findChild(file, track.trak, fourcc("tkhd"), &tkhd) ||
+            !findChild(file, track.mdia, fourcc("mdhd"), &mdhd))
+        return false;
+
+    const quint32 movieTimescale = readTimescale(file, mvhd);
+    const quint32 mediaTimescale = readTimescale(file, mdhd);
+    if (!movieTimescale || !mediaTimescale)
+        return false;
+    const quint64 movieDuration = mediaDuration * movieTimescale / mediaTimescale;
+
+    const QByteArray movieHeader = patchDuration(file, mvhd, 16, 24, movieDuration);
+    const QByteArray trackHeader = patchDuration(file, tkhd, 20, 28, movieDuration);
+    const QByteArray mediaHeader = patchDuration(file, mdhd, 16, 24, mediaDuration);
+    if (movieHeader.isEmpty() || trackHeader.isEmpty() || mediaHeader.isEmpty())
+        return false;
+
+    const QByteArray minf = rebuildBox(file, track.minf, {
+        { fourcc("stbl"), makeBox(fourcc("stbl"), sampleTable) },
+    });
+    const QByteArray mdia = rebuildBox(file, track.mdia, {
+        { fourcc("mdhd"), mediaHeader },
+        { fourcc("minf"), minf },
+    });
+    // The edit list refers to the old duration, the implicit one covers the whole track.
+    const QByteArray trak = rebuildBox(file, track.trak, {
+        { fourcc("tkhd"), trackHeader },
+        { fourcc("edts"), QByteArray() },
+        { fourcc("mdia"), mdia },
+    });
+    const QByteArray moov = rebuildBox(file, track.moov, {
+        { fourcc("mvhd"), movieHeader },
+        { fourcc("trak"), trak },
+    });
+
+    QByteArray head;
+    QByteArray renditions;
+    const QVector<KDynamicWallpaperBox> boxes = parseBoxes(file);
+    for (const KDynamicWallpaperBox &box : boxes) {
+        KDynamicWallpaperRendition rendition;
+        switch (box.type) {
+        case fourcc("moov"):
+            head += moov;
+            break;
+        case fourcc("mdat"):
+        case fourcc("free"):
+        case fourcc("skip"):
+            break;
+        case fourcc("uuid"):
+            // The binary metadata is rewritten by the caller.
+            if (isMetaDataBox(boxPayload(file, box).left(metaDataHeaderSize), box))
+                break;
+            // The renditions are remuxed the same way. They're optional, so drop them if that fails.
+            if (readRenditionHeader(boxPayload(file, box).left(renditionHeaderSize), box, &rendition)) {
+                QByteArray remuxedRendition;
+                if (remux(file.mid(rendition.offset, rendition.length), sampleIndices, QByteArray(), &remuxedRendition))
+                    renditions += makeRendition(rendition.size, sampleIndices.count(), remuxedRendition);
+                break;
+            }
+            head += file.mid(box.offset, box.size);
+            break;
+        default:
+            head += file.mid(box.offset, box.size);
+            break;
+        }
+    }
+
+    // The samples come first in the new mdat box, followed by the XMP packet and the data of
+    // other items. Items that share their data keep sharing it.
+    QVector<Patch> patches;
+    QHash<QPair<quint64, quint64>, quint64> copiedExtents;
+    qint64 xmpOffset = -1;
+
+    const QVector<KDynamicWallpaperBox> metaBoxes = findMetaBoxes(head);
+    for (const KDynamicWallpaperBox &metaBox : metaBoxes) {
+        const qint64 metaOffset = metaBox.offset + metaBox.headerSize;
+        const QByteArray payload = boxPayload(head, metaBox);
+
+        // The meta box is a full box, skip the version and the flags.
+        const QVector<KDynamicWallpaperBox> metaChildren = parseBoxes(payload, 4);
+        QHash<quint32, KDynamicWallpaperItem> items;
+        if (const KDynamicWallpaperBox *iinf = findBox(metaChildren, fourcc("iinf")))
+            readItemInfo(boxPayload(payload, *iinf), &items);
+
+        quint32 primaryItemId = 0;
+        if (const KDynamicWallpaperBox *pitm = findBox(metaChildren, fourcc("pitm"))) {
+            QDataStream stream(boxPayload(payload, *pitm));
+            quint8 version;
+            stream >> version;
+            stream.skipRawData(3);
+            if (version == 0) {
+                quint16 shortItemId;
+                stream >> shortItemId;
+                primaryItemId = shortItemId;
+            } else {
+                stream >> primaryItemId;
+            }
+        }
+
+        const KDynamicWallpaperBox *iloc = findBox(metaChildren, fourcc("iloc"));
+        if (!iloc)
+            continue;
+        if (!readItemLocations(boxPayload(payload, *iloc), &items))
+            return false;
+
+        const qint64 ilocOffset = metaOffset + iloc->offset + iloc->headerSize;
+        for (auto it = items.constBegin(); it != items.constEnd(); ++it) {
+            const KDynamicWallpaperItem &item = it.value();
+            if (item.constructionMethod != 0)
+                continue;
+
+            if (item.type == fourcc("mime") && item.contentType == QByteArrayLiteral("application/rdf+xml")) {
+                if (item.extents.count() != 1)
+                    return false;
+                if (xmpOffset == -1) {
+                    xmpOffset = media.size();
+                    media += xmp;
+                }
+                const KDynamicWallpaperItemExtent &extent = item.extents.first();
+                patches.append({ ilocOffset + extent.offsetField.position, extent.offsetField, xmpOffset - item.baseOffset, true });
+                patches.append({ ilocOffset + extent.lengthField.position, extent.lengthField, quint64(xmp.size()), false });
+                continue;
+            }
+
+            // The still image that precedes the image sequence is the first frame.
+            if (it.key() == primaryItemId && item.extents.count() == 1) {
+                const KDynamicWallpaperItemExtent &extent = item.extents.first();
+                const KDynamicWallpaperSample &firstSample = samples.first();
+                if (item.baseOffset + extent.offset == firstSample.offset && extent.length == firstSample.size) {
+                    patches.append({ ilocOffset + extent.offsetField.position, extent.offsetField, 0 - item.baseOffset, true });
+                    patches.append({ ilocOffset + extent.lengthField.position, extent.lengthField, samples[sampleIndices.first()].size, false });
+                    continue;
+                }
+            }
+
+            for (const KDynamicWallpaperItemExtent &extent : item.extents) {
+                const quint64 offset = item.baseOffset + extent.offset;
+                if (!extent.length || offset + extent.length > quint64(file.size()))
+                    return false;
+                const QPair<quint64, quint64> key(offset, extent.length);
+                if (!copiedExtents.contains(key)) {
+                    copiedExtents.insert(key, media.size());
+                    media.append(file.constData() + offset, extent.length);
+                }
+                patches.append({ ilocOffset + extent.offsetField.position, extent.offsetField, copiedExtents.value(key) - item.baseOffset, true });
+            }
+        }
+    }
+
+    if (xmpOffset == -1 && !xmp.isEmpty())
+        return false;
+
+    // The chunk offset and the item offsets are 32 bits wide in the files we write.
+    const quint64 mediaOffset = head.size() + 8;
+    if (mediaOffset + media.size() > std::numeric_limits<quint32>::max())
+        return false;
+
+    for (const Patch &patch : qAsConst(patches)) {
+        const quint64 value = patch.isRelative ? mediaOffset + patch.value : patch.value;
+        if (!writeVariableSizeInteger(head.data(), patch.position, patch.field, value))
+            return false;
+    }
+
+    KDynamicWallpaperTrack newTrack;
+    KDynamicWallpaperBox stco;
+    if (!findTrack(head, &newTrack) || !findChild(head, newTrack.stbl, fourcc("stco"), &stco))
+        return false;
+    qToBigEndian<quint32>(mediaOffset, head.data() + stco.offset + stco.headerSize + 8);
+
+    *output = head + makeBox(fourcc("mdat"), media) + renditions;
+    return true;
+}
@@ -0,0 +1,108 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QSize>
+#include <QVector>
+
+class QDataStream;
+
+constexpr quint32 fourcc(const char (&name)[5])
+{
+    return quint32(uchar(name[0])) << 24 | quint32(uchar(name[1])) << 16 |
+        quint32(uchar(name[2])) << 8 | quint32(uchar(name[3]));
+}
+
+class KDynamicWallpaperBox
+{
+public:
+    quint32 type = 0;
+    qint64 offset = 0;
+    qint64 size = 0;
+    int headerSize = 0;
+};
+
+class KDynamicWallpaperField
+{
+public:
+    int position = -1;
+    int size = 0;
+};
+
+class KDynamicWallpaperItemExtent
+{
+public:
+    quint64 offset = 0;
+    quint64 length = 0;
+    KDynamicWallpaperField offsetField;
+    KDynamicWallpaperField lengthField;
+};
+
+class KDynamicWallpaperItem
+{
+public:
+    quint32 type = 0;
+    QByteArray contentType;
+    QSize size;
+    int constructionMethod = 0;
+    quint64 baseOffset = 0;
+    QVector<KDynamicWallpaperItemExtent> extents;
+};
+
+class KDynamicWallpaperSample
+{
+public:
+    quint64 offset = 0;
+    quint32 size = 0;
+    quint32 duration = 0;
+    bool isSyncSample = true;
+};
+
+class KDynamicWallpaperRendition
+{
+public:
+    QSize size;
+    int imageCount = 0;
+    qint64 offset = 0;
+    qint64 length = 0;
+};
+
+class KDynamicWallpaperIsoBmff
+{
+public:
+    static bool parseBoxHeader(const QByteArray &data, qint64 available, KDynamicWallpaperBox *box);
+    static QVector<KDynamicWallpaperBox> parseBoxes(const QByteArray &data, int offset = 0);
+    static QByteArray boxPayload(const QByteArray &data, const KDynamicWallpaperBox &box);
+    static const KDynamicWallpaperBox *findBox(const QVector<KDynamicWallpaperBox> &boxes, quint32 type);
+    static quint64 readVariableSizeInteger(QDataStream &stream, int size);
+
+    static bool isAvifFileType(const QByteArray &payload);
+    static void readItemInfo(const QByteArray &payload, QHash<quint32, KDynamicWallpaperItem> *items);
+    static bool readItemLocations(const QByteArray &payload, QHash<quint32, KDynamicWallpaperItem> *items);
+    static void readItemProperties(const QByteArray &payload, QHash<quint32, KDynamicWallpaperItem> *items);
+
+    static const int renditionHeaderSize = 28;
+    static QByteArray makeRendition(const QSize &size, int imageCount, const QByteArray &file);
+    static QByteArray makeRenditionHeader(const QSize &size, int imageCount, qint64 fileSize);
+    static bool readRenditionHeader(const QByteArray &header, const KDynamicWallpaperBox &box,
+                                    KDynamicWallpaperRendition *rendition);
+
+    static const int metaDataHeaderSize = 16;
+    static QByteArray makeMetaDataBox(const QByteArray &cbor);
+    static bool isMetaDataBox(const QByteArray &header, const KDynamicWallpaperBox &box);
+    static void replaceMetaDataBox(QByteArray *file, const QByteArray &cbor);
+
+    static bool readSamples(const QByteArray &file, QVector<KDynamicWallpaperSample> *samples);
+
+    static bool replaceMetaData(QByteArray *file, const QByteArray &xmp);
+    static bool replaceMetaData(char *file, int fileSize, qint64 appendOffset,
+                                const QByteArray &xmp, QByteArray *appendix);
+    static bool remux(const QByteArray &file, const QVector<int> &sampleIndices,
+                      const QByteArray &xmp, QByteArray *output);
+};
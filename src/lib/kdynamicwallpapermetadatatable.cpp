@@ -0,0 +1,435 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "kdynamicwallpapermetadatatable.h"
+
+#include <QCborArray>
+#include <QCborMap>
+#include <QJsonObject>
+#include <QSharedData>
+
+/*!
+ * \class KDynamicWallpaperMetaDataTable
+ * \brief The KDynamicWallpaperMetaDataTable class stores the metadata of all images in a
+ * dynamic wallpaper in a compact form.
+ *
+ * Unlike a list of KDynamicWallpaperMetaData objects, which allocates every entry on the heap,
+ * the table keeps each field of all entries in its own contiguous array. This makes it cheap to
+ * load the metadata of wallpapers with thousands of images, and lets code that needs only one
+ * field, e.g. the times of all images, scan it with a tight loop.
+ *
+ * The table can be (de)serialized in bulk. toJson() produces the same array of objects as
+ * KDynamicWallpaperMetaData::toJson() does for individual entries, while toCbor() stores every
+ * field as a single array, which is much more compact.
+ */
+
+static const QLatin1String s_crossFadeKey("CrossFade");
+static const QLatin1String s_timeKey("Time");
+static const QLatin1String s_solarElevationKey("Elevation");
+static const QLatin1String s_solarAzimuthKey("Azimuth");
+static const QLatin1String s_indexKey("Index");
+
+class KDynamicWallpaperMetaDataTablePrivate : public QSharedData
+{
+public:
+    void reserve(int size);
+    bool append(KDynamicWallpaperMetaData::MetaDataFields rowFields,
+                KDynamicWallpaperMetaData::CrossFadeMode crossFadeMode,
+                qreal time, qreal solarElevation, qreal solarAzimuth, int index);
+
+    QVector<KDynamicWallpaperMetaData::MetaDataFields> fields;
+    QVector<KDynamicWallpaperMetaData::CrossFadeMode> crossFadeModes;
+    QVector<qreal> times;
+    QVector<qreal> solarElevations;
+    QVector<qreal> solarAzimuths;
+    QVector<int> indices;
+};
+
+void KDynamicWallpaperMetaDataTablePrivate::reserve(int size)
+{
+    fields.reserve(size);
+    crossFadeModes.reserve(size);
+    times.reserve(size);
+    solarElevations.reserve(size);
+    solarAzimuths.reserve(size);
+    indices.reserve(size);
+}
+
+/*!
+ * \internal
+ *
+ * Appends a row to the table if it would make valid KDynamicWallpaperMetaData, and returns
+ * \c true; otherwise the row is dropped and \c false is returned.
+ */
+bool KDynamicWallpaperMetaDataTablePrivate::append(KDynamicWallpaperMetaData::MetaDataFields rowFields,
+                                                   KDynamicWallpaperMetaData::CrossFadeMode crossFadeMode,
+                                                   qreal time, qreal solarElevation, qreal solarAzimuth, int index)
+{
+    const KDynamicWallpaperMetaData::MetaDataFields requiredFields =
+        KDynamicWallpaperMetaData::TimeField | KDynamicWallpaperMetaData::IndexField;
+    if ((rowFields & requiredFields) != requiredFields)
+        return false;
+    if (bool(rowFields & KDynamicWallpaperMetaData::SolarAzimuthField) ^
+            bool(rowFields & KDynamicWallpaperMetaData::SolarElevationField))
+        return false;
+    if (time < 0 || time > 1)
+        return false;
+
+    fields.append(rowFields);
+    crossFadeModes.append(crossFadeMode);
+    times.append(time);
+    solarElevations.append(solarElevation);
+    solarAzimuths.append(solarAzimuth);
+    indices.append(index);
+    return true;
+}
+
+/*!
+ * Constructs an empty KDynamicWallpaperMetaDataTable object.
+ */
+KDynamicWallpaperMetaDataTable::KDynamicWallpaperMetaDataTable()
+    : d(new KDynamicWallpaperMetaDataTablePrivate)
+{
+}
+
+/*!
+ * Constructs a KDynamicWallpaperMetaDataTable object with the entries in \p metaData. Invalid
+ * entries are skipped.
+ */
+KDynamicWallpaperMetaDataTable::KDynamicWallpaperMetaDataTable(const QList<KDynamicWallpaperMetaData> &metaData)
+    : d(new KDynamicWallpaperMetaDataTablePrivate)
+{
+    d->reserve(metaData.count());
+    for (const KDynamicWallpaperMetaData &md : metaData)
+        append(md);
+}
+
+/*!
+ * Constructs a copy of the KDynamicWallpaperMetaDataTable object.
+ */
+KDynamicWallpaperMetaDataTable::KDynamicWallpaperMetaDataTable(const KDynamicWallpaperMetaDataTable &other)
+    : d(other.d)
+{
+}
+
+/*!
+ * Destructs the KDynamicWallpaperMetaDataTable object.
+ */
+KDynamicWallpaperMetaDataTable::~KDynamicWallpaperMetaDataTable()
+{
+}
+
+/*!
+ * Assigns the value of \p other to a dynamic wallpaper metadata table object.
+ */
+KDynamicWallpaperMetaDataTable &KDynamicWallpaperMetaDataTable::operator=(const KDynamicWallpaperMetaDataTable &other)
+{
+    d = other.d;
+    return *this;
+}
+
+/*!
+ * Returns \c true if the table has no entries; otherwise returns \c false.
+ */
+bool KDynamicWallpaperMetaDataTable::isEmpty() const
+{
+    return d->indices.isEmpty();
+}
+
+/*!
+ * Returns the number of entries in the table.
+ */
+int KDynamicWallpaperMetaDataTable::count() const
+{
+    return d->indices.count();
+}
+
+/*!
+ * Preallocates memory for \p size entries.
+ */
+void KDynamicWallpaperMetaDataTable::reserve(int size)
+{
+    d->reserve(size);
+}
+
+/*!
+ * Removes all entries from the table.
+ */
+void KDynamicWallpaperMetaDataTable::clear()
+{
+    d = new KDynamicWallpaperMetaDataTablePrivate;
+}
+
+/*!
+ * Appends \p metaData to the table. Invalid metadata is ignored.
+ */
+void KDynamicWallpaperMetaDataTable::append(const KDynamicWallpaperMetaData &metaData)
+{
+    d->append(metaData.fields(), metaData.crossFadeMode(), metaData.time(),
+              metaData.solarElevation(), metaData.solarAzimuth(), metaData.index());
+}
+
+/*!
+ * Returns the entry at the specified \p row as a KDynamicWallpaperMetaData object.
+ *
+ * This method will return an invalid KDynamicWallpaperMetaData if \p row is outside of the
+ * valid range.
+ */
+KDynamicWallpaperMetaData KDynamicWallpaperMetaDataTable::at(int row) const
+{
+    if (row < 0 || row >= count())
+        return KDynamicWallpaperMetaData();
+
+    const KDynamicWallpaperMetaData::MetaDataFields rowFields = d->fields[row];
+
+    KDynamicWallpaperMetaData metaData;
+    metaData.setIndex(d->indices[row]);
+    metaData.setTime(d->times[row]);
+    if (rowFields & KDynamicWallpaperMetaData::CrossFadeField)
+        metaData.setCrossFadeMode(d->crossFadeModes[row]);
+    if (rowFields & KDynamicWallpaperMetaData::SolarElevationField)
+        metaData.setSolarElevation(d->solarElevations[row]);
+    if (rowFields & KDynamicWallpaperMetaData::SolarAzimuthField)
+        metaData.setSolarAzimuth(d->solarAzimuths[row]);
+
+    return metaData;
+}
+
+/*!
+ * Returns all entries in the table as a list of KDynamicWallpaperMetaData objects.
+ */
+QList<KDynamicWallpaperMetaData> KDynamicWallpaperMetaDataTable::toList() const
+{
+    QList<KDynamicWallpaperMetaData> metaData;
+    metaData.reserve(count());
+    for (int i = 0; i < count(); ++i)
+        metaData.append(at(i));
+    return metaData;
+}
+
+/*!
+ * Returns the fields that are present in all entries of the table.
+ */
+KDynamicWallpaperMetaData::MetaDataFields KDynamicWallpaperMetaDataTable::commonFields() const
+{
+    if (isEmpty())
+        return KDynamicWallpaperMetaData::MetaDataFields();
+
+    KDynamicWallpaperMetaData::MetaDataFields result = d->fields.first();
+    for (const KDynamicWallpaperMetaData::MetaDataFields &rowFields : qAsConst(d->fields))
+        result &= rowFields;
+    return result;
+}
+
+/*!
+ * Returns the present fields of all entries.
+ */
+QVector<KDynamicWallpaperMetaData::MetaDataFields> KDynamicWallpaperMetaDataTable::fields() const
+{
+    return d->fields;
+}
+
+/*!
+ * Returns the cross-fade modes of all entries. Entries without the cross-fade field have the
+ * NoCrossFade mode.
+ */
+QVector<KDynamicWallpaperMetaData::CrossFadeMode> KDynamicWallpaperMetaDataTable::crossFadeModes() const
+{
+    return d->crossFadeModes;
+}
+
+/*!
+ * Returns the times of all entries.
+ */
+QVector<qreal> KDynamicWallpaperMetaDataTable::times() const
+{
+    return d->times;
+}
+
+/*!
+ * Returns the solar elevations of all entries. Entries without solar metadata have the
+ * elevation of 0.
+ */
+QVector<qreal> KDynamicWallpaperMetaDataTable::solarElevations() const
+{
+    return d->solarElevations;
+}
+
+/*!
+ * Returns the solar azimuths of all entries. Entries without solar metadata have the azimuth
+ * of 0.
+ */
+QVector<qreal> KDynamicWallpaperMetaDataTable::solarAzimuths() const
+{
+    return d->solarAzimuths;
+}
+
+/*!
+ * Returns the image indices of all entries.
+ */
+QVector<int> KDynamicWallpaperMetaDataTable::indices() const
+{
+    return d->indices;
+}
+
+/*!
+ * Converts the table to a JSON array of objects, one per entry.
+ */
+QJsonArray KDynamicWallpaperMetaDataTable::toJson() const
+{
+    QJsonArray array;
+    for (int i = 0; i < count(); ++i) {
+        const KDynamicWallpaperMetaData::MetaDataFields rowFields = d->fields[i];
+
+        QJsonObject object;
+        if (rowFields & KDynamicWallpaperMetaData::CrossFadeField)
+            object[s_crossFadeKey] = d->crossFadeModes[i] == KDynamicWallpaperMetaData::CrossFade;
+        if (rowFields & KDynamicWallpaperMetaData::SolarElevationField)
+            object[s_solarElevationKey] = d->solarElevations[i];
+        if (rowFields & KDynamicWallpaperMetaData::SolarAzimuthField)
+            object[s_solarAzimuthKey] = d->solarAzimuths[i];
+        object[s_timeKey] = d->times[i];
+        object[s_indexKey] = d->indices[i];
+
+        array.append(object);
+    }
+    return array;
+}
+
+/*!
+ * Decodes a JSON array of metadata objects. Invalid entries are skipped.
+ */
+KDynamicWallpaperMetaDataTable KDynamicWallpaperMetaDataTable::fromJson(const QJsonArray &array)
+{
+    KDynamicWallpaperMetaDataTable table;
+    table.reserve(array.size());
+
+    for (const QJsonValue &value : array) {
+        const QJsonObject object = value.toObject();
+        KDynamicWallpaperMetaData::MetaDataFields rowFields;
+
+        const QJsonValue index = object[s_indexKey];
+        if (index.isDouble())
+            rowFields |= KDynamicWallpaperMetaData::IndexField;
+
+        const QJsonValue crossFadeMode = object[s_crossFadeKey];
+        if (crossFadeMode.isBool())
+            rowFields |= KDynamicWallpaperMetaData::CrossFadeField;
+
+        const QJsonValue time = object[s_timeKey];
+        if (time.isDouble())
+            rowFields |= KDynamicWallpaperMetaData::TimeField;
+
+        const QJsonValue solarElevation = object[s_solarElevationKey];
+        if (solarElevation.isDouble())
+            rowFields |= KDynamicWallpaperMetaData::SolarElevationField;
+
+        const QJsonValue solarAzimuth = object[s_solarAzimuthKey];
+        if (solarAzimuth.isDouble())
+            rowFields |= KDynamicWallpaperMetaData::SolarAzimuthField;
+
+        table.d->append(rowFields,
+                        crossFadeMode.toBool() ? KDynamicWallpaperMetaData::CrossFade : KDynamicWallpaperMetaData::NoCrossFade,
+                        time.toDouble(), solarElevation.toDouble(), solarAzimuth.toDouble(), index.toInt(-1));
+    }
+
+    return table;
+}
+
+/*!
+ * Converts the table to a CBOR map that stores each field of all entries as an array. Fields
+ * that are missing in an entry are stored as CBOR nulls.
+ */
+QCborValue KDynamicWallpaperMetaDataTable::toCbor() const
+{
+    QCborArray crossFadeModes;
+    QCborArray times;
+    QCborArray solarElevations;
+    QCborArray solarAzimuths;
+    QCborArray indices;
+
+    for (int i = 0; i < count(); ++i) {
+        const KDynamicWallpaperMetaData::MetaDataFields rowFields = d->fields[i];
+
+        if (rowFields & KDynamicWallpaperMetaData::CrossFadeField)
+            crossFadeModes.append(d->crossFadeModes[i] == KDynamicWallpaperMetaData::CrossFade);
+        else
+            crossFadeModes.append(QCborValue(QCborValue::Null));
+
+        if (rowFields & KDynamicWallpaperMetaData::SolarElevationField)
+            solarElevations.append(d->solarElevations[i]);
+        else
+            solarElevations.append(QCborValue(QCborValue::Null));
+
+        if (rowFields & KDynamicWallpaperMetaData::SolarAzimuthField)
+            solarAzimuths.append(d->solarAzimuths[i]);
+        else
+            solarAzimuths.append(QCborValue(QCborValue::Null));
+
+        times.append(d->times[i]);
+        indices.append(d->indices[i]);
+    }
+
+    QCborMap map;
+    map[s_crossFadeKey] = crossFadeModes;
+    map[s_timeKey] = times;
+    map[s_solarElevationKey] = solarElevations;
+    map[s_solarAzimuthKey] = solarAzimuths;
+    map[s_indexKey] = indices;
+    return map;
+}
+
+/*!
+ * Decodes a CBOR map produced by toCbor(). Invalid entries are skipped. An empty table is
+ * returned if the arrays have different lengths.
+ */
+KDynamicWallpaperMetaDataTable KDynamicWallpaperMetaDataTable::fromCbor(const QCborValue &value)
+{
+    const QCborMap map = value.toMap();
+    const QCborArray crossFadeModes = map[s_crossFadeKey].toArray();
+    const QCborArray times = map[s_timeKey].toArray();
+    const QCborArray solarElevations = map[s_solarElevationKey].toArray();
+    const QCborArray solarAzimuths = map[s_solarAzimuthKey].toArray();
+    const QCborArray indices = map[s_indexKey].toArray();
+
+    const qsizetype rowCount = indices.size();
+    if (times.size() != rowCount || crossFadeModes.size() != rowCount ||
+            solarElevations.size() != rowCount || solarAzimuths.size() != rowCount)
+        return KDynamicWallpaperMetaDataTable();
+
+    KDynamicWallpaperMetaDataTable table;
+    table.reserve(rowCount);
+
+    for (qsizetype i = 0; i < rowCount; ++i) {
+        KDynamicWallpaperMetaData::MetaDataFields rowFields;
+
+        const QCborValue index = indices[i];
+        if (index.isInteger())
+            rowFields |= KDynamicWallpaperMetaData::IndexField;
+
+        const QCborValue crossFadeMode = crossFadeModes[i];
+        if (crossFadeMode.isBool())
+            rowFields |= KDynamicWallpaperMetaData::CrossFadeField;
+
+        const QCborValue time = times[i];
+        if (time.isDouble() || time.isInteger())
+            rowFields |= KDynamicWallpaperMetaData::TimeField;
+
+        const QCborValue solarElevation = solarElevations[i];
+        if (solarElevation.isDouble() || solarElevation.isInteger())
+            rowFields |= KDynamicWallpaperMetaData::SolarElevationField;
+
+        const QCborValue solarAzimuth = solarAzimuths[i];
+        if (solarAzimuth.isDouble() || solarAzimuth.isInteger())
+            rowFields |= KDynamicWallpaperMetaData::SolarAzimuthField;
+
+        table.d->append(rowFields,
+                        crossFadeMode.toBool() ? KDynamicWallpaperMetaData::CrossFade : KDynamicWallpaperMetaData::NoCrossFade,
+                        time.toDouble(), solarElevation.toDouble(), solarAzimuth.toDouble(), index.toInteger(-1));
+    }
+
+    return table;
+}
@@ -0,0 +1,57 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "kdynamicwallpaper_export.h"
+#include "kdynamicwallpapermetadata.h"
+
+#include <QCborValue>
+#include <QJsonArray>
+#include <QList>
+#include <QSharedDataPointer>
+#include <QVector>
+
+class KDynamicWallpaperMetaDataTablePrivate;
+
+class KDYNAMICWALLPAPER_EXPORT KDynamicWallpaperMetaDataTable
+{
+public:
+    KDynamicWallpaperMetaDataTable();
+    explicit KDynamicWallpaperMetaDataTable(const QList<KDynamicWallpaperMetaData> &metaData);
+    KDynamicWallpaperMetaDataTable(const KDynamicWallpaperMetaDataTable &other);
+    ~KDynamicWallpaperMetaDataTable();
+
+    KDynamicWallpaperMetaDataTable &operator=(const KDynamicWallpaperMetaDataTable &other);
+
+    bool isEmpty() const;
+    int count() const;
+
+    void reserve(int size);
+    void clear();
+    void append(const KDynamicWallpaperMetaData &metaData);
+
+    KDynamicWallpaperMetaData at(int row) const;
+    QList<KDynamicWallpaperMetaData> toList() const;
+
+    KDynamicWallpaperMetaData::MetaDataFields commonFields() const;
+
+    QVector<KDynamicWallpaperMetaData::MetaDataFields> fields() const;
+    QVector<KDynamicWallpaperMetaData::CrossFadeMode> crossFadeModes() const;
+    QVector<qreal> times() const;
+    QVector<qreal> solarElevations() const;
+    QVector<qreal> solarAzimuths() const;
+    QVector<int> indices() const;
+
+    QJsonArray toJson() const;
+    QCborValue toCbor() const;
+
+    static KDynamicWallpaperMetaDataTable fromJson(const QJsonArray &array);
+    static KDynamicWallpaperMetaDataTable fromCbor(const QCborValue &value);
+
+private:
+    QSharedDataPointer<KDynamicWallpaperMetaDataTablePrivate> d;
+};
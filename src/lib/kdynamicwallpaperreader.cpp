@@ -5,16 +5,26 @@
  */
 
 #include "kdynamicwallpaperreader.h"
+#include "kdynamicwallpapercbor_p.h"
+#include "kdynamicwallpaperimagescaler_p.h"
+#include "kdynamicwallpaperisobmff_p.h"
 #include "kdynamicwallpapermetadata.h"
+#include "kdynamicwallpapermetadatatable.h"
+#include "kdynamicwallpaperxmp_p.h"
 
-#include <QDomDocument>
-#include <QDomNode>
 #include <QFile>
+#include <QFileDevice>
+#include <QFutureInterface>
 #include <QImage>
-#include <QJsonArray>
-#include <QJsonDocument>
+#include <QMutex>
+#include <QRunnable>
 #include <QScopeGuard>
 #include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <QtConcurrent>
+
+#include <algorithm>
 
 #include <avif/avif.h>
 
@@ -27,8 +37,33 @@
  * return a null QImage or an invalid KDynamicWallpaperMetaData, respectively. You can
  * then call error() to find out the type of the error that occurred, or errorString() to
  * get a human readable description of what went wrong.
+ *
+ * The const methods of KDynamicWallpaperReader are thread-safe. Every thread that decodes an
+ * image borrows its own decoder, which is returned to the reader afterwards and reused by the
+ * following requests, so the container is not parsed again every time an image is decoded.
+ * Several images can be decoded in parallel with images(), and imageAsync() decodes an image
+ * in the background.
+ *
+ * If the wallpaper contains downscaled renditions of its images, the smallest rendition that
+ * still provides enough pixels is decoded when an image is requested at a smaller size.
  */
 
+/*!
+ * \internal
+ *
+ * The KDynamicWallpaperReaderSource class describes an image sequence in the wallpaper, either
+ * the full-size images or one of their downscaled renditions, along with the idle decoders
+ * that read from it.
+ */
+class KDynamicWallpaperReaderSource
+{
+public:
+    QSize size;
+    qint64 offset = 0;
+    qint64 length = 0;
+    QVector<avifDecoder *> decoders;
+};
+
 class KDynamicWallpaperReaderPrivate
 {
 public:
@@ -36,52 +71,133 @@ public:
 
     bool open();
     void close();
+    void readBoxes();
+    QByteArray read(qint64 offset, qint64 size);
+
+    avifResult createDecoder(int sourceIndex, avifDecoder **decoder);
+    avifDecoder *acquireDecoder(int sourceIndex, int imageIndex);
+    void releaseDecoder(int sourceIndex, avifDecoder *decoder);
+
+    int selectSource(const QSize &size, const QRect &sourceRect, QRect *mappedRect) const;
+    QImage fetch(int imageIndex, const QSize &size, const QRect &sourceRect, QImage::Format format,
+                 const QFutureInterface<QImage> *future = nullptr);
+    QImage decode(int sourceIndex, int imageIndex, const QSize &size, const QRect &sourceRect,
+                  QImage::Format format, const QFutureInterface<QImage> *future);
+    QImage convert(int sourceIndex, const avifImage *image, QImage::Format format);
 
-    QImage fetch(int imageIndex);
+    void setError(KDynamicWallpaperReader::WallpaperReaderError error, const QString &text);
+    void setDecodeError(int sourceIndex, avifResult result);
 
     QIODevice *device;
     QByteArray buffer;
-    avifDecoder *decoder;
+    uchar *mappedData;
+    QVector<KDynamicWallpaperReaderSource> sources;
+    QMutex deviceMutex;
+    mutable QMutex mutex;
+    QThreadPool threadPool;
     KDynamicWallpaperReader::WallpaperReaderError wallpaperReaderError;
     QString errorString;
-    QList<KDynamicWallpaperMetaData> metaData;
+    KDynamicWallpaperMetaDataTable metaData;
+    QSize imageSize;
+    int imageCount;
     bool isDeviceForeign;
 };
 
 KDynamicWallpaperReaderPrivate::KDynamicWallpaperReaderPrivate()
     : device(nullptr)
-    , decoder(nullptr)
+    , mappedData(nullptr)
     , wallpaperReaderError(KDynamicWallpaperReader::NoError)
+    , imageCount(0)
     , isDeviceForeign(false)
 {
 }
 
-static QList<KDynamicWallpaperMetaData> parseMetaData(const QByteArray &xmp)
+/*!
+ * \internal
+ *
+ * The KDynamicWallpaperIO struct provides an avifIO that serves data straight from a QIODevice
+ * rather than from a copy of the whole file in the heap.
+ *
+ * If the device is a file that can be mapped into memory, reads simply return pointers into the
+ * mapping, so only the pages of the items that are actually decoded are faulted in. Otherwise,
+ * every read seeks the device and copies the requested range into a scratch buffer. Since all
+ * decoders of a reader share the device, such reads are serialized with the device mutex.
+ */
+struct KDynamicWallpaperIO
 {
-    QDomDocument xmpDocument;
-    xmpDocument.setContent(xmp);
-    if (xmpDocument.isNull())
-        return QList<KDynamicWallpaperMetaData>();
+    avifIO io;
+    QIODevice *device;
+    QMutex *deviceMutex;
+    const uchar *data;
+    qint64 offset;
+    QByteArray buffer;
+};
 
-    const QString attributeName = QStringLiteral("plasma:dynamic-wallpaper-solar");
-    const QDomNodeList descriptionNodes = xmpDocument.elementsByTagName(QStringLiteral("rdf:Description"));
-    for (int i = 0; i < descriptionNodes.count(); ++i) {
-        QDomElement descriptionNode = descriptionNodes.at(i).toElement();
-        const QByteArray base64 = descriptionNode.attribute(attributeName).toUtf8();
-        if (base64.isEmpty())
-            continue;
+static avifResult readMappedData(avifIO *io, uint32_t readFlags, uint64_t offset, size_t size, avifROData *out)
+{
+    Q_UNUSED(readFlags)
 
-        const QJsonArray array = QJsonDocument::fromJson(QByteArray::fromBase64(base64)).array();
-        QList<KDynamicWallpaperMetaData> result;
-        for (int i = 0; i < array.size(); ++i) {
-            KDynamicWallpaperMetaData metaData = KDynamicWallpaperMetaData::fromJson(array[i].toObject());
-            if (metaData.isValid())
-                result.append(metaData);
-        }
-        return result;
-    }
+    const KDynamicWallpaperIO *self = reinterpret_cast<KDynamicWallpaperIO *>(io);
+    if (offset > io->sizeHint)
+        return AVIF_RESULT_IO_ERROR;
+
+    out->data = self->data + offset;
+    out->size = std::min<uint64_t>(size, io->sizeHint - offset);
+
+    return AVIF_RESULT_OK;
+}
+
+static avifResult readDeviceData(avifIO *io, uint32_t readFlags, uint64_t offset, size_t size, avifROData *out)
+{
+    Q_UNUSED(readFlags)
 
-    return QList<KDynamicWallpaperMetaData>();
+    KDynamicWallpaperIO *self = reinterpret_cast<KDynamicWallpaperIO *>(io);
+    if (offset > io->sizeHint)
+        return AVIF_RESULT_IO_ERROR;
+
+    QMutexLocker locker(self->deviceMutex);
+    if (!self->device->seek(self->offset + offset))
+        return AVIF_RESULT_IO_ERROR;
+
+    self->buffer.resize(std::min<uint64_t>(size, io->sizeHint - offset));
+
+    const qint64 bytesRead = self->device->read(self->buffer.data(), self->buffer.size());
+    if (bytesRead < 0)
+        return AVIF_RESULT_IO_ERROR;
+
+    out->data = reinterpret_cast<const uint8_t *>(self->buffer.constData());
+    out->size = bytesRead;
+
+    return AVIF_RESULT_OK;
+}
+
+static void destroyIO(avifIO *io)
+{
+    delete reinterpret_cast<KDynamicWallpaperIO *>(io);
+}
+
+/*!
+ * \internal
+ *
+ * Creates an avifIO that reads \p length bytes starting at \p offset in the device, or in the
+ * mapped \p data if it's not \c nullptr.
+ */
+static avifIO *createIO(QIODevice *device, QMutex *deviceMutex, const uchar *data, qint64 offset, qint64 length)
+{
+    KDynamicWallpaperIO *self = new KDynamicWallpaperIO;
+    self->device = device;
+    self->deviceMutex = deviceMutex;
+    self->data = data ? data + offset : nullptr;
+    self->offset = offset;
+
+    self->io.destroy = destroyIO;
+    self->io.read = data ? readMappedData : readDeviceData;
+    self->io.write = nullptr;
+    self->io.sizeHint = length;
+    self->io.persistent = data != nullptr;
+    self->io.data = nullptr;
+
+    return &self->io;
 }
 
 bool KDynamicWallpaperReaderPrivate::open()
@@ -106,87 +222,420 @@ bool KDynamicWallpaperReaderPrivate::open()
         }
     }
 
-    decoder = avifDecoderCreate();
-    decoder->maxThreads = QThread::idealThreadCount();
+    // Avoid copying the whole file into the heap if possible. Files are mapped into memory,
+    // other random-access devices are read on demand, and only sequential devices are slurped.
+    if (QFileDevice *file = qobject_cast<QFileDevice *>(device))
+        mappedData = file->map(0, file->size());
+    if (!mappedData && device->isSequential())
+        buffer = device->readAll();
 
-    auto cleanup = qScopeGuard([this]() {
-        avifDecoderDestroy(decoder);
-        decoder = nullptr;
-    });
+    KDynamicWallpaperReaderSource mainSource;
+    mainSource.length = device->isSequential() ? buffer.size() : device->size();
+    sources.append(mainSource);
 
-    buffer = device->readAll();
-    avifResult result = avifDecoderSetIOMemory(decoder, reinterpret_cast<const uint8_t *>(buffer.constData()), buffer.size());
+    avifDecoder *decoder = nullptr;
+    const avifResult result = createDecoder(0, &decoder);
     if (result != AVIF_RESULT_OK) {
         wallpaperReaderError = KDynamicWallpaperReader::OpenError;
         errorString = QString::fromUtf8(avifResultToString(result));
         return false;
     }
 
-    result = avifDecoderParse(decoder);
-    if (result != AVIF_RESULT_OK) {
-        wallpaperReaderError = KDynamicWallpaperReader::OpenError;
-        errorString = QString::fromUtf8(avifResultToString(result));
-        return false;
-    }
+    auto cleanup = qScopeGuard([decoder]() {
+        avifDecoderDestroy(decoder);
+    });
 
-    if (!decoder->image->xmp.size) {
-        wallpaperReaderError = KDynamicWallpaperReader::OpenError;
-        errorString = QStringLiteral("No metadata");
-        return false;
+    imageCount = decoder->imageCount;
+    imageSize = QSize(decoder->image->width, decoder->image->height);
+    sources[0].size = imageSize;
+
+    readBoxes();
+
+    // Files written by older versions of the library have no binary metadata block.
+    if (metaData.isEmpty()) {
+        const avifRWData &xmp = decoder->image->xmp;
+        metaData = KDynamicWallpaperXmp::parse(QByteArray::fromRawData(reinterpret_cast<const char *>(xmp.data), xmp.size));
     }
 
-    metaData = parseMetaData(QByteArray::fromRawData(reinterpret_cast<const char *>(decoder->image->xmp.data), decoder->image->xmp.size));
     if (metaData.isEmpty()) {
+        // The image count gates the image requests, and the renditions have been matched
+        // against it, so a reader that failed to open must not keep any of them.
+        imageCount = 0;
+        imageSize = QSize();
+        sources.resize(1);
         wallpaperReaderError = KDynamicWallpaperReader::OpenError;
         errorString = QStringLiteral("No metadata");
         return false;
     }
 
+    // Keep the decoder that parsed the container around for the first image request.
     cleanup.dismiss();
+    sources[0].decoders.append(decoder);
+
     return true;
 }
 
+/*!
+ * \internal
+ *
+ * Reads \p size bytes at the specified \p offset in the wallpaper.
+ */
+QByteArray KDynamicWallpaperReaderPrivate::read(qint64 offset, qint64 size)
+{
+    if (mappedData)
+        return QByteArray::fromRawData(reinterpret_cast<const char *>(mappedData) + offset, size);
+    if (device->isSequential())
+        return QByteArray::fromRawData(buffer.constData() + offset, size);
+
+    QMutexLocker locker(&deviceMutex);
+    if (!device->seek(offset))
+        return QByteArray();
+    return device->read(size);
+}
+
+/*!
+ * \internal
+ *
+ * Looks for the binary metadata and downscaled renditions of the images among the top-level
+ * boxes. Both are optional, so the renditions that don't match the full-size images and the
+ * metadata that can't be parsed are ignored.
+ */
+void KDynamicWallpaperReaderPrivate::readBoxes()
+{
+    const qint64 fileSize = sources[0].length;
+    qint64 offset = 0;
+
+    while (offset < fileSize) {
+        KDynamicWallpaperBox box;
+        const QByteArray header = read(offset, std::min<qint64>(16, fileSize - offset));
+        if (!KDynamicWallpaperIsoBmff::parseBoxHeader(header, fileSize - offset, &box))
+            break;
+        box.offset = offset;
+        offset += box.size;
+
+        if (box.type != fourcc("uuid"))
+            continue;
+
+        const qint64 payloadSize = box.size - box.headerSize;
+        if (metaData.isEmpty() && payloadSize >= KDynamicWallpaperIsoBmff::metaDataHeaderSize) {
+            const QByteArray metaDataHeader = read(box.offset + box.headerSize, KDynamicWallpaperIsoBmff::metaDataHeaderSize);
+            if (KDynamicWallpaperIsoBmff::isMetaDataBox(metaDataHeader, box)) {
+                const qint64 metaDataOffset = box.offset + box.headerSize + KDynamicWallpaperIsoBmff::metaDataHeaderSize;
+                metaData = KDynamicWallpaperCbor::parse(read(metaDataOffset, payloadSize - KDynamicWallpaperIsoBmff::metaDataHeaderSize));
+                continue;
+            }
+        }
+
+        if (payloadSize <= KDynamicWallpaperIsoBmff::renditionHeaderSize)
+            continue;
+
+        KDynamicWallpaperRendition rendition;
+        const QByteArray renditionHeader = read(box.offset + box.headerSize, KDynamicWallpaperIsoBmff::renditionHeaderSize);
+        if (!KDynamicWallpaperIsoBmff::readRenditionHeader(renditionHeader, box, &rendition))
+            continue;
+        if (rendition.imageCount != imageCount)
+            continue;
+        if (rendition.size.width() >= imageSize.width() || rendition.size.height() >= imageSize.height())
+            continue;
+
+        KDynamicWallpaperReaderSource source;
+        source.size = rendition.size;
+        source.offset = rendition.offset;
+        source.length = rendition.length;
+        sources.append(source);
+    }
+
+    // The smallest suitable rendition is picked by walking the renditions in this order.
+    std::sort(sources.begin() + 1, sources.end(), [](const KDynamicWallpaperReaderSource &a,
+                                                     const KDynamicWallpaperReaderSource &b) {
+        return qint64(a.size.width()) * a.size.height() < qint64(b.size.width()) * b.size.height();
+    });
+}
+
 void KDynamicWallpaperReaderPrivate::close()
 {
-    if (decoder)
-        avifDecoderDestroy(decoder);
+    // Drop the asynchronous requests that haven't started yet and wait for the running ones.
+    threadPool.clear();
+    threadPool.waitForDone();
+
+    // The decoders must be destroyed before the memory mapping they read from goes away.
+    for (const KDynamicWallpaperReaderSource &source : qAsConst(sources)) {
+        for (avifDecoder *decoder : source.decoders)
+            avifDecoderDestroy(decoder);
+    }
+    if (mappedData)
+        static_cast<QFileDevice *>(device)->unmap(mappedData);
     if (!isDeviceForeign)
-        device->deleteLater();
+        delete device;
 
-    decoder = nullptr;
+    sources.clear();
     device = nullptr;
+    mappedData = nullptr;
     isDeviceForeign = false;
+    imageCount = 0;
+    imageSize = QSize();
     buffer.clear();
 }
 
-QImage KDynamicWallpaperReaderPrivate::fetch(int index)
+/*!
+ * \internal
+ *
+ * Creates a decoder that reads the source with the specified \p sourceIndex from the assigned
+ * device and parses the container.
+ */
+avifResult KDynamicWallpaperReaderPrivate::createDecoder(int sourceIndex, avifDecoder **decoder)
+{
+    const KDynamicWallpaperReaderSource &source = sources.at(sourceIndex);
+
+    *decoder = avifDecoderCreate();
+    (*decoder)->maxThreads = QThread::idealThreadCount();
+
+    auto cleanup = qScopeGuard([decoder]() {
+        avifDecoderDestroy(*decoder);
+        *decoder = nullptr;
+    });
+
+    if (mappedData) {
+        avifDecoderSetIO(*decoder, createIO(device, &deviceMutex, mappedData, source.offset, source.length));
+    } else if (!device->isSequential()) {
+        avifDecoderSetIO(*decoder, createIO(device, &deviceMutex, nullptr, source.offset, source.length));
+    } else {
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(buffer.constData()) + source.offset;
+        const avifResult result = avifDecoderSetIOMemory(*decoder, data, source.length);
+        if (result != AVIF_RESULT_OK)
+            return result;
+    }
+
+    const avifResult result = avifDecoderParse(*decoder);
+    if (result != AVIF_RESULT_OK)
+        return result;
+
+    cleanup.dismiss();
+    return AVIF_RESULT_OK;
+}
+
+/*!
+ * \internal
+ *
+ * Returns an idle decoder for the source with the specified \p sourceIndex, or creates a new one
+ * if all decoders of the source are busy in other threads.
+ *
+ * The images are inter-coded, so decoding an image means decoding every image since the
+ * nearest key frame. A decoder remembers the last image it has decoded, so the idle decoder
+ * that needs to decode the fewest images to get to \p imageIndex is picked. Advancing to the
+ * next image, which is what the wallpaper does most of the time, decodes a single image.
+ */
+avifDecoder *KDynamicWallpaperReaderPrivate::acquireDecoder(int sourceIndex, int imageIndex)
 {
-    avifResult result = avifDecoderNthImage(decoder, index);
+    {
+        QMutexLocker locker(&mutex);
+        QVector<avifDecoder *> &decoders = sources[sourceIndex].decoders;
+        if (!decoders.isEmpty() && (imageIndex < 0 || imageIndex >= imageCount))
+            return decoders.takeLast();
+        if (!decoders.isEmpty()) {
+            const int keyFrameIndex = avifDecoderNearestKeyframe(decoders.first(), imageIndex);
+
+            auto decodeCount = [imageIndex, keyFrameIndex](const avifDecoder *decoder) {
+                if (decoder->imageIndex == imageIndex)
+                    return 0;
+                if (decoder->imageIndex < imageIndex && decoder->imageIndex >= keyFrameIndex - 1)
+                    return imageIndex - decoder->imageIndex;
+                return imageIndex - keyFrameIndex + 1;
+            };
+
+            int bestIndex = 0;
+            for (int i = 1; i < decoders.count(); ++i) {
+                if (decodeCount(decoders[i]) < decodeCount(decoders[bestIndex]))
+                    bestIndex = i;
+            }
+
+            return decoders.takeAt(bestIndex);
+        }
+    }
+
+    avifDecoder *decoder = nullptr;
+    const avifResult result = createDecoder(sourceIndex, &decoder);
     if (result != AVIF_RESULT_OK) {
-        wallpaperReaderError = KDynamicWallpaperReader::ReadError;
-        errorString = QString::fromUtf8(avifResultToString(result));
+        setDecodeError(sourceIndex, result);
+        return nullptr;
+    }
+
+    return decoder;
+}
+
+/*!
+ * \internal
+ *
+ * Returns the \p decoder of the source with the specified \p sourceIndex to the reader so it
+ * can be reused by subsequent requests.
+ */
+void KDynamicWallpaperReaderPrivate::releaseDecoder(int sourceIndex, avifDecoder *decoder)
+{
+    QMutexLocker locker(&mutex);
+    sources[sourceIndex].decoders.append(decoder);
+}
+
+void KDynamicWallpaperReaderPrivate::setError(KDynamicWallpaperReader::WallpaperReaderError error, const QString &text)
+{
+    QMutexLocker locker(&mutex);
+    wallpaperReaderError = error;
+    errorString = text;
+}
+
+/*!
+ * \internal
+ *
+ * Records that decoding an image from the source with the specified \p sourceIndex failed with
+ * \p result. A broken rendition is not an error since the full-size image is decoded instead.
+ */
+void KDynamicWallpaperReaderPrivate::setDecodeError(int sourceIndex, avifResult result)
+{
+    if (sourceIndex == 0)
+        setError(KDynamicWallpaperReader::ReadError, QString::fromUtf8(avifResultToString(result)));
+}
+
+/*!
+ * \internal
+ *
+ * Returns the index of the smallest source that provides at least \p size pixels for the region
+ * \p sourceRect of the full-size image, and stores the region in the coordinates of the source
+ * in \p mappedRect.
+ */
+int KDynamicWallpaperReaderPrivate::selectSource(const QSize &size, const QRect &sourceRect, QRect *mappedRect) const
+{
+    *mappedRect = sourceRect;
+    if (!size.isValid())
+        return 0;
+
+    const QRect imageRect(QPoint(0, 0), imageSize);
+    const QRect clipRect = sourceRect.isValid() ? sourceRect & imageRect : imageRect;
+    if (clipRect.isEmpty())
+        return 0;
+
+    for (int i = 1; i < sources.count(); ++i) {
+        const qreal scaleX = qreal(sources[i].size.width()) / imageSize.width();
+        const qreal scaleY = qreal(sources[i].size.height()) / imageSize.height();
+        if (clipRect.width() * scaleX < size.width() || clipRect.height() * scaleY < size.height())
+            continue;
+
+        if (sourceRect.isValid()) {
+            const QRectF scaledRect(clipRect.x() * scaleX, clipRect.y() * scaleY,
+                                    clipRect.width() * scaleX, clipRect.height() * scaleY);
+            *mappedRect = scaledRect.toAlignedRect() & QRect(QPoint(0, 0), sources[i].size);
+        }
+        return i;
+    }
+
+    return 0;
+}
+
+QImage KDynamicWallpaperReaderPrivate::fetch(int index, const QSize &size, const QRect &sourceRect,
+                                             QImage::Format format, const QFutureInterface<QImage> *future)
+{
+    QRect mappedRect;
+    const int sourceIndex = selectSource(size, sourceRect, &mappedRect);
+    if (sourceIndex != 0) {
+        const QImage image = decode(sourceIndex, index, size, mappedRect, format, future);
+        if (!image.isNull() || (future && future->isCanceled()))
+            return image;
+        // The rendition is broken, the full-size image will do as well.
+    }
+
+    return decode(0, index, size, sourceRect, format, future);
+}
+
+QImage KDynamicWallpaperReaderPrivate::decode(int sourceIndex, int index, const QSize &size, const QRect &sourceRect,
+                                              QImage::Format format, const QFutureInterface<QImage> *future)
+{
+    avifDecoder *decoder = acquireDecoder(sourceIndex, index);
+    if (!decoder)
+        return QImage();
+
+    auto cleanup = qScopeGuard([this, sourceIndex, decoder]() {
+        releaseDecoder(sourceIndex, decoder);
+    });
+
+    const avifResult result = avifDecoderNthImage(decoder, index);
+    if (result != AVIF_RESULT_OK) {
+        setDecodeError(sourceIndex, result);
         return QImage();
     }
 
-    const QImage::Format qtFormat = QImage::Format_RGB32;
+    // Decoding is the most expensive part, but don't convert an image nobody is waiting for.
+    if (future && future->isCanceled())
+        return QImage();
+
+    const QRect imageRect(0, 0, decoder->image->width, decoder->image->height);
+    const QRect clipRect = sourceRect.isValid() ? sourceRect & imageRect : imageRect;
+    if (clipRect.isEmpty())
+        return QImage();
+
+    const QSize targetSize = size.isValid() ? size : clipRect.size();
+    if (clipRect == imageRect && targetSize == imageRect.size())
+        return convert(sourceIndex, decoder->image, format);
+
+    // If only a part of the image is needed or the image is scaled down, convert and scale
+    // the needed pixels in one pass so the full-size RGB image is never materialized.
+    if (clipRect.width() >= targetSize.width() && clipRect.height() >= targetSize.height() &&
+            KDynamicWallpaperImageScaler::canScale(decoder->image, format)) {
+        return KDynamicWallpaperImageScaler::scale(decoder->image, clipRect, targetSize, format);
+    }
+
+    QImage image = convert(sourceIndex, decoder->image, format);
+    if (clipRect != imageRect)
+        image = image.copy(clipRect);
+    if (image.size() != targetSize)
+        image = image.scaled(targetSize);
+    if (image.format() != format)
+        image = image.convertToFormat(format);
+    return image;
+}
+
+static bool avifFormatForQtFormat(QImage::Format format, avifRGBFormat *avifFormat)
+{
+    // The images are opaque, so the premultiplied formats share the layout with their straight
+    // counterparts. libavif fills the alpha channel with the maximum value.
+    switch (format) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
 #if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
-    const avifRGBFormat avifFormat = AVIF_RGB_FORMAT_BGRA;
+        *avifFormat = AVIF_RGB_FORMAT_BGRA;
 #else
-    const avifRGBFormat avifFormat = AVIF_RGB_FORMAT_ARGB;
+        *avifFormat = AVIF_RGB_FORMAT_ARGB;
 #endif
+        return true;
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888:
+    case QImage::Format_RGBA8888_Premultiplied:
+        *avifFormat = AVIF_RGB_FORMAT_RGBA;
+        return true;
+    case QImage::Format_RGB888:
+        *avifFormat = AVIF_RGB_FORMAT_RGB;
+        return true;
+    default:
+        return false;
+    }
+}
+
+QImage KDynamicWallpaperReaderPrivate::convert(int sourceIndex, const avifImage *avif, QImage::Format format)
+{
+    avifRGBFormat avifFormat;
+    if (!avifFormatForQtFormat(format, &avifFormat))
+        return convert(sourceIndex, avif, QImage::Format_RGB32).convertToFormat(format);
 
-    QImage image(decoder->image->width, decoder->image->height, qtFormat);
+    QImage image(avif->width, avif->height, format);
 
     avifRGBImage rgb;
-    avifRGBImageSetDefaults(&rgb, decoder->image);
+    avifRGBImageSetDefaults(&rgb, avif);
     rgb.format = avifFormat;
+    rgb.depth = 8;
     rgb.rowBytes = image.bytesPerLine();
     rgb.pixels = image.bits();
 
-    result = avifImageYUVToRGB(decoder->image, &rgb);
+    const avifResult result = avifImageYUVToRGB(avif, &rgb);
     if (result != AVIF_RESULT_OK) {
-        wallpaperReaderError = KDynamicWallpaperReader::ReadError;
-        errorString = QString::fromUtf8(avifResultToString(result));
+        setDecodeError(sourceIndex, result);
         return QImage();
     }
 
@@ -195,6 +644,62 @@ QImage KDynamicWallpaperReaderPrivate::fetch(int index)
     return image;
 }
 
+/*!
+ * \internal
+ *
+ * The KDynamicWallpaperImageTask class decodes an image for imageAsync() in the thread pool of
+ * the reader.
+ */
+class KDynamicWallpaperImageTask : public QRunnable
+{
+public:
+    KDynamicWallpaperImageTask(KDynamicWallpaperReaderPrivate *d, int imageIndex, const QSize &size,
+                               const QRect &sourceRect, QImage::Format format);
+    ~KDynamicWallpaperImageTask() override;
+
+    void run() override;
+
+    QFutureInterface<QImage> future;
+
+private:
+    KDynamicWallpaperReaderPrivate *d;
+    int imageIndex;
+    QSize size;
+    QRect sourceRect;
+    QImage::Format format;
+};
+
+KDynamicWallpaperImageTask::KDynamicWallpaperImageTask(KDynamicWallpaperReaderPrivate *d, int imageIndex,
+                                                       const QSize &size, const QRect &sourceRect,
+                                                       QImage::Format format)
+    : d(d)
+    , imageIndex(imageIndex)
+    , size(size)
+    , sourceRect(sourceRect)
+    , format(format)
+{
+    future.reportStarted();
+}
+
+KDynamicWallpaperImageTask::~KDynamicWallpaperImageTask()
+{
+    // The task may be destroyed without being run if the reader is closed.
+    if (!future.isFinished()) {
+        future.reportCanceled();
+        future.reportFinished();
+    }
+}
+
+void KDynamicWallpaperImageTask::run()
+{
+    if (!future.isCanceled()) {
+        const QImage image = d->fetch(imageIndex, size, sourceRect, format, &future);
+        if (!future.isCanceled())
+            future.reportResult(image);
+    }
+    future.reportFinished();
+}
+
 /*!
  * Constructs an empty KDynamicWallpaperReader object.
  */
@@ -235,6 +740,10 @@ KDynamicWallpaperReader::~KDynamicWallpaperReader()
  *
  * If the device is not already open, KDynamicWallpaperReader will attempt to open the device
  * in QIODevice::ReadOnly mode by calling open().
+ *
+ * If the device is a QFileDevice, its contents will be mapped into memory rather than read
+ * in advance. Other random-access devices are read on demand, so the device must outlive the
+ * reader.
  */
 void KDynamicWallpaperReader::setDevice(QIODevice *device)
 {
@@ -283,13 +792,22 @@ QString KDynamicWallpaperReader::fileName() const
  */
 int KDynamicWallpaperReader::imageCount() const
 {
-    return d->decoder->imageCount;
+    return d->imageCount;
 }
 
 /*!
  * Returns the KDynamicWallpaperMetaData objects for the current wallpaper.
  */
 QList<KDynamicWallpaperMetaData> KDynamicWallpaperReader::metaData() const
+{
+    return d->metaData.toList();
+}
+
+/*!
+ * Returns the metadata of the current wallpaper as a table, without creating an object for
+ * every entry.
+ */
+KDynamicWallpaperMetaDataTable KDynamicWallpaperReader::metaDataTable() const
 {
     return d->metaData;
 }
@@ -301,9 +819,89 @@ QList<KDynamicWallpaperMetaData> KDynamicWallpaperReader::metaData() const
  */
 QImage KDynamicWallpaperReader::image(int imageIndex) const
 {
-    if (!d->decoder)
+    if (!d->imageCount)
         return QImage();
-    return d->fetch(imageIndex);
+    return d->fetch(imageIndex, QSize(), QRect(), QImage::Format_RGB32);
+}
+
+/*!
+ * Returns the region \p sourceRect of the image with the specified index \p imageIndex scaled
+ * to \p size. The aspect ratio is not preserved.
+ *
+ * If \p sourceRect is not valid, the whole image is returned. If \p size is not valid, the
+ * region is returned at its native size.
+ *
+ * The image is written directly in the specified \p format if it is one of the 32-bit RGB
+ * formats, including the premultiplied ones, or QImage::Format_RGB888. Other formats need an
+ * extra conversion pass.
+ *
+ * When scaling down or clipping, only the pixels inside \p sourceRect are converted to RGB,
+ * and they are scaled in the same pass, without allocating an intermediate full-size image.
+ * If the wallpaper contains downscaled renditions of its images, the smallest rendition that
+ * is at least as large as \p size is decoded instead of the full-size image.
+ *
+ * This method will return a null QImage object if \p imageIndex is outside of the valid range.
+ */
+QImage KDynamicWallpaperReader::image(int imageIndex, const QSize &size, const QRect &sourceRect,
+                                      QImage::Format format) const
+{
+    if (!d->imageCount)
+        return QImage();
+    return d->fetch(imageIndex, size, sourceRect, format);
+}
+
+/*!
+ * Decodes the region \p sourceRect of the image with the specified index \p imageIndex in the
+ * background and returns a future for the image, scaled to \p size in the given \p format.
+ *
+ * The returned future can be canceled. If it is canceled before the image has been decoded,
+ * the image is not converted to RGB and the future reports no result.
+ *
+ * If the reader is destroyed or assigned another device, pending requests are canceled and
+ * the running ones are waited for.
+ */
+QFuture<QImage> KDynamicWallpaperReader::imageAsync(int imageIndex, const QSize &size, const QRect &sourceRect,
+                                                    QImage::Format format) const
+{
+    KDynamicWallpaperImageTask *task = new KDynamicWallpaperImageTask(d.data(), imageIndex, size, sourceRect, format);
+    const QFuture<QImage> future = task->future.future();
+
+    if (d->imageCount)
+        d->threadPool.start(task);
+    else
+        delete task;
+
+    return future;
+}
+
+/*!
+ * Returns the images with the specified indices \p imageIndices, scaled to \p size in the
+ * given \p format.
+ *
+ * The images are decoded in parallel, each by its own decoder. Images with invalid indices
+ * are returned as null QImage objects.
+ */
+QVector<QImage> KDynamicWallpaperReader::images(const QVector<int> &imageIndices, const QSize &size,
+                                                QImage::Format format) const
+{
+    if (!d->imageCount)
+        return QVector<QImage>(imageIndices.count());
+
+    std::function<QImage(int)> fetch = [this, size, format](int imageIndex) {
+        return d->fetch(imageIndex, size, QRect(), format);
+    };
+
+    return QtConcurrent::blockingMapped<QVector<QImage>>(imageIndices, fetch);
+}
+
+/*!
+ * Returns the size of the image with the specified index \p imageIndex, without decoding it.
+ */
+QSize KDynamicWallpaperReader::imageSize(int imageIndex) const
+{
+    if (imageIndex < 0 || imageIndex >= d->imageCount)
+        return QSize();
+    return d->imageSize;
 }
 
 /*!
@@ -311,6 +909,7 @@ QImage KDynamicWallpaperReader::image(int imageIndex) const
  */
 KDynamicWallpaperReader::WallpaperReaderError KDynamicWallpaperReader::error() const
 {
+    QMutexLocker locker(&d->mutex);
     return d->wallpaperReaderError;
 }
 
@@ -319,6 +918,7 @@ KDynamicWallpaperReader::WallpaperReaderError KDynamicWallpaperReader::error() c
  */
 QString KDynamicWallpaperReader::errorString() const
 {
+    QMutexLocker locker(&d->mutex);
     if (d->wallpaperReaderError == NoError)
         return QStringLiteral("No error");
     return d->errorString;
@@ -8,9 +8,14 @@
 
 #include "kdynamicwallpaper_export.h"
 
+#include <QFuture>
 #include <QIODevice>
+#include <QImage>
+#include <QRect>
+#include <QVector>
 
 class KDynamicWallpaperMetaData;
+class KDynamicWallpaperMetaDataTable;
 class KDynamicWallpaperReaderPrivate;
 
 class KDYNAMICWALLPAPER_EXPORT KDynamicWallpaperReader
@@ -34,9 +39,17 @@ public:
     QString fileName() const;
 
     QList<KDynamicWallpaperMetaData> metaData() const;
+    KDynamicWallpaperMetaDataTable metaDataTable() const;
 
     int imageCount() const;
+    QSize imageSize(int imageIndex) const;
     QImage image(int imageIndex) const;
+    QImage image(int imageIndex, const QSize &size, const QRect &sourceRect = QRect(),
+                 QImage::Format format = QImage::Format_RGB32) const;
+    QVector<QImage> images(const QVector<int> &imageIndices, const QSize &size = QSize(),
+                           QImage::Format format = QImage::Format_RGB32) const;
+    QFuture<QImage> imageAsync(int imageIndex, const QSize &size = QSize(), const QRect &sourceRect = QRect(),
+                               QImage::Format format = QImage::Format_RGB32) const;
 
     WallpaperReaderError error() const;
     QString errorString() const;
@@ -0,0 +1,118 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "kdynamicwallpaperreaderpool.h"
+#include "kdynamicwallpaperreader.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+
+/*!
+ * \class KDynamicWallpaperReaderPool
+ * \brief The KDynamicWallpaperReaderPool class shares KDynamicWallpaperReader objects within
+ * the process.
+ *
+ * Opening a dynamic wallpaper involves mapping the file and parsing the container and the
+ * metadata. KDynamicWallpaperReaderPool makes sure that this work is done only once per file,
+ * no matter how many screens or layers show the same wallpaper. The few most recently used
+ * readers are kept alive even if nobody references them, so the next request for the same
+ * file, e.g. at the next keyframe transition, does not have to open the file again.
+ *
+ * Readers are keyed by the canonical path as well as the modification time and the size of
+ * the file, so a wallpaper that has been modified on disk is opened anew.
+ *
+ * All methods of KDynamicWallpaperReaderPool are thread-safe.
+ */
+
+static const int s_maxIdleReaders = 4;
+
+class KDynamicWallpaperReaderPoolPrivate
+{
+public:
+    QMutex mutex;
+    QHash<QString, QWeakPointer<const KDynamicWallpaperReader>> readers;
+    QVector<QSharedPointer<const KDynamicWallpaperReader>> recentReaders;
+};
+
+Q_GLOBAL_STATIC(KDynamicWallpaperReaderPoolPrivate, s_pool)
+
+static QString keyForFile(const QFileInfo &fileInfo)
+{
+    return fileInfo.canonicalFilePath() + QLatin1Char(':') +
+            QString::number(fileInfo.lastModified().toMSecsSinceEpoch()) + QLatin1Char(':') +
+            QString::number(fileInfo.size());
+}
+
+/*!
+ * Returns a reader for the dynamic wallpaper with the specified file name \p fileName.
+ *
+ * If the file cannot be opened, the returned reader will be in an error state. Such readers
+ * are not shared. A shared reader that has failed to decode an image is replaced with a new one.
+ */
+QSharedPointer<const KDynamicWallpaperReader> KDynamicWallpaperReaderPool::acquire(const QString &fileName)
+{
+    const QFileInfo fileInfo(fileName);
+    if (!fileInfo.exists())
+        return QSharedPointer<const KDynamicWallpaperReader>::create(fileName);
+
+    const QString key = keyForFile(fileInfo);
+
+    // The readers that are dropped by the pool may be the last references to them. They are
+    // destroyed after the lock has been released since closing a reader waits for pending decodes.
+    QSharedPointer<const KDynamicWallpaperReader> evictedReader;
+    QSharedPointer<const KDynamicWallpaperReader> failedReader;
+
+    QMutexLocker locker(&s_pool->mutex);
+
+    QSharedPointer<const KDynamicWallpaperReader> reader = s_pool->readers.value(key).toStrongRef();
+    if (reader && reader->error() != KDynamicWallpaperReader::NoError) {
+        // The reader has failed to decode an image, and its error state sticks. Don't let that
+        // fail every later request for the file, open the file anew instead.
+        s_pool->recentReaders.removeOne(reader);
+        s_pool->readers.remove(key);
+        failedReader.swap(reader);
+    }
+
+    if (!reader) {
+        // The reader is created with the lock held so concurrent requests for the same file,
+        // e.g. from the top and the bottom layer, don't open the file twice.
+        reader = QSharedPointer<const KDynamicWallpaperReader>::create(fileInfo.canonicalFilePath());
+        if (reader->error() != KDynamicWallpaperReader::NoError)
+            return reader;
+
+        for (auto it = s_pool->readers.begin(); it != s_pool->readers.end();) {
+            if (it->isNull())
+                it = s_pool->readers.erase(it);
+            else
+                ++it;
+        }
+        s_pool->readers.insert(key, reader);
+    }
+
+    s_pool->recentReaders.removeOne(reader);
+    s_pool->recentReaders.prepend(reader);
+    if (s_pool->recentReaders.count() > s_maxIdleReaders)
+        evictedReader = s_pool->recentReaders.takeLast();
+
+    return reader;
+}
+
+/*!
+ * Releases the readers that are kept alive by the pool. Readers that are still referenced
+ * elsewhere remain valid.
+ */
+void KDynamicWallpaperReaderPool::clear()
+{
+    // The readers are destroyed after the lock has been released.
+    QVector<QSharedPointer<const KDynamicWallpaperReader>> recentReaders;
+
+    QMutexLocker locker(&s_pool->mutex);
+    recentReaders.swap(s_pool->recentReaders);
+    s_pool->readers.clear();
+}
@@ -0,0 +1,20 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "kdynamicwallpaper_export.h"
+
+#include <QSharedPointer>
+
+class KDynamicWallpaperReader;
+
+class KDYNAMICWALLPAPER_EXPORT KDynamicWallpaperReaderPool
+{
+public:
+    static QSharedPointer<const KDynamicWallpaperReader> acquire(const QString &fileName);
+    static void clear();
+};
@@ -5,13 +5,26 @@
  */
 
 #include "kdynamicwallpaperwriter.h"
+#include "kdynamicwallpapercbor_p.h"
+#include "kdynamicwallpaperencodecache_p.h"
+#include "kdynamicwallpaperencoderoptions.h"
+#include "kdynamicwallpaperisobmff_p.h"
 #include "kdynamicwallpapermetadata.h"
+#include "kdynamicwallpapermetadatatable.h"
+#include "kdynamicwallpaperxmp_p.h"
 
+#include <QByteArrayList>
+#include <QCryptographicHash>
 #include <QFile>
-#include <QJsonArray>
-#include <QJsonDocument>
 #include <QImage>
+#include <QQueue>
+#include <QScopeGuard>
 #include <QThread>
+#include <QVector>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <numeric>
 
 #include <avif/avif.h>
 
@@ -20,96 +33,591 @@
  * \brief The KDynamicWallpaperWriter class provides a convenient way for writing dynamic
  * wallpapers.
  *
+ * The images can be either set in advance with setImages() and written with flush(), or they
+ * can be added one at a time between begin() and finish(), which keeps the memory usage bounded
+ * no matter how many images the wallpaper contains.
+ *
+ * If a cache directory is set with setCacheDirectory(), the encoded wallpapers are kept on disk
+ * and reused as long as the images and the encoder options stay the same. This makes it cheap
+ * to write a wallpaper again after only its metadata has changed.
+ *
+ * If the encoder options specify rendition sizes, each image is also encoded at those sizes.
+ * The renditions are stored after the full-size images, where decoders that don't know about
+ * them skip them, and KDynamicWallpaperReader uses them to decode small images quickly.
+ *
  * If any error occurs when writing an image, write() will return false. You can then call
  * error() to find the type of the error that occurred, or errorString() to get a human
  * readable description of what went wrong.
  */
 
+// Frames are converted to YUV ahead of the encoder, up to one frame per core so that all cores
+// are busy converting, but every converted frame is kept in memory until the encoder gets to it.
+// The lookahead is limited so that the converted frames fit in this budget, e.g. five 8K frames.
+static const qint64 s_pendingImageBudget = 512 * 1024 * 1024;
+
+static int maxPendingImages(const QSize &imageSize)
+{
+    // A YUV 4:4:4 frame takes three bytes per pixel, the renditions are much smaller.
+    const qint64 frameSize = std::max<qint64>(1, qint64(imageSize.width()) * imageSize.height() * 3);
+    const qint64 threadCount = QThread::idealThreadCount();
+    return int(std::max<qint64>(2, std::min(threadCount, s_pendingImageBudget / frameSize)));
+}
+
+// The encoded wallpaper is written to the device in chunks of this size.
+static const int s_chunkSize = 1024 * 1024;
+
+static avifPixelFormat pixelFormatForChromaSubsampling(KDynamicWallpaperEncoderOptions::ChromaSubsampling subsampling)
+{
+    switch (subsampling) {
+    case KDynamicWallpaperEncoderOptions::Yuv444:
+        return AVIF_PIXEL_FORMAT_YUV444;
+    case KDynamicWallpaperEncoderOptions::Yuv422:
+        return AVIF_PIXEL_FORMAT_YUV422;
+    case KDynamicWallpaperEncoderOptions::Yuv420:
+        return AVIF_PIXEL_FORMAT_YUV420;
+    default:
+        Q_UNREACHABLE();
+    }
+}
+
+static const char *codecName(KDynamicWallpaperEncoderOptions::Codec codec)
+{
+    switch (codec) {
+    case KDynamicWallpaperEncoderOptions::AomCodec:
+        return "aom";
+    case KDynamicWallpaperEncoderOptions::Rav1eCodec:
+        return "rav1e";
+    case KDynamicWallpaperEncoderOptions::SvtCodec:
+        return "svt";
+    default:
+        return nullptr;
+    }
+}
+
+class KDynamicWallpaperWriterFrame
+{
+public:
+    avifImage *image = nullptr;
+    QVector<avifImage *> renditions;
+};
+
+class KDynamicWallpaperWriterRendition
+{
+public:
+    QSize size;
+    avifEncoder *encoder = nullptr;
+};
+
+class KDynamicWallpaperWriterSource
+{
+public:
+    QString fileName;
+    QImage image;
+};
+
 class KDynamicWallpaperWriterPrivate
 {
 public:
     KDynamicWallpaperWriterPrivate();
 
-    void flush(QIODevice *device);
+    bool begin(QIODevice *device, bool isDeviceForeign);
+    bool configureEncoder(avifEncoder *encoder);
+    bool createRenditions(const QSize &imageSize);
+    bool addImage(const QImage &image);
+    bool addSource(const KDynamicWallpaperWriterSource &source, const QImage &image);
+    bool encodeSources();
+    bool encodePendingImage();
+    bool finishEncoding(QVector<avifRWData> *outputs);
+    bool finish();
+    bool write(const QByteArrayList &parts);
+    void abort();
+
+    void setError(KDynamicWallpaperWriter::WallpaperWriterError error, const QString &text);
+
+    static avifImage *convert(const QImage &image, avifPixelFormat pixelFormat);
+    static KDynamicWallpaperWriterFrame convertFrame(const QImage &image, avifPixelFormat pixelFormat,
+                                                     const QVector<QSize> &renditionSizes);
+    static void destroyFrame(const KDynamicWallpaperWriterFrame &frame);
 
     KDynamicWallpaperWriter::WallpaperWriterError wallpaperWriterError;
     QString errorString;
     QList<QImage> images;
     QList<KDynamicWallpaperMetaData> metaData;
+    KDynamicWallpaperEncoderOptions encoderOptions;
+    QString cacheDirectory;
+    QIODevice *device;
+    avifEncoder *encoder;
+    QVector<KDynamicWallpaperWriterRendition> renditions;
+    QQueue<QFuture<KDynamicWallpaperWriterFrame>> pendingImages;
+    QVector<KDynamicWallpaperWriterSource> sources;
+    QCryptographicHash contentHash;
+    QByteArray initialXmp;
+    int encodedImageCount;
+    bool isDeviceForeign;
+    bool isCaching;
+    bool hasRenditions;
 };
 
 KDynamicWallpaperWriterPrivate::KDynamicWallpaperWriterPrivate()
     : wallpaperWriterError(KDynamicWallpaperWriter::NoError)
+    , device(nullptr)
+    , encoder(nullptr)
+    , contentHash(QCryptographicHash::Sha256)
+    , encodedImageCount(0)
+    , isDeviceForeign(false)
+    , isCaching(false)
+    , hasRenditions(false)
 {
 }
 
-static QByteArray serializeMetaData(const QList<KDynamicWallpaperMetaData> &metaData)
+void KDynamicWallpaperWriterPrivate::setError(KDynamicWallpaperWriter::WallpaperWriterError error, const QString &text)
 {
-    QJsonArray array;
-    for (const KDynamicWallpaperMetaData &md : metaData)
-        array.append(md.toJson());
+    wallpaperWriterError = error;
+    errorString = text;
+}
 
-    QJsonDocument document;
-    document.setArray(array);
+/*!
+ * \internal
+ *
+ * Converts the specified RGB \p image to a YUV image with the given \p pixelFormat that can be
+ * fed to the encoder. Returns \c nullptr if the conversion fails.
+ *
+ * This function can be called from multiple threads simultaneously.
+ */
+avifImage *KDynamicWallpaperWriterPrivate::convert(const QImage &image, avifPixelFormat pixelFormat)
+{
+    const QImage rgbImage = image.convertToFormat(QImage::Format_RGB888);
+    avifImage *avif = avifImageCreate(rgbImage.width(), rgbImage.height(), 8, pixelFormat);
+
+    avifRGBImage rgb;
+    avifRGBImageSetDefaults(&rgb, avif);
 
-    const QByteArray base64 = document.toJson(QJsonDocument::Compact).toBase64();
-    QFile templateFile(QStringLiteral(":/kdynamicwallpaper/xmp/metadata.xml"));
-    templateFile.open(QFile::ReadOnly);
+    rgb.format = AVIF_RGB_FORMAT_RGB;
+    rgb.depth = 8;
+    rgb.rowBytes = rgbImage.bytesPerLine();
+    rgb.pixels = const_cast<uint8_t *>(rgbImage.constBits());
 
-    QByteArray xmp = templateFile.readAll();
-    xmp.replace(QByteArrayLiteral("base64"), base64);
-    return xmp;
+    // TODO: color space
+
+    const avifResult result = avifImageRGBToYUV(avif, &rgb);
+    if (result != AVIF_RESULT_OK) {
+        avifImageDestroy(avif);
+        return nullptr;
+    }
+
+    return avif;
 }
 
-void KDynamicWallpaperWriterPrivate::flush(QIODevice *device)
+/*!
+ * \internal
+ *
+ * Converts the specified \p image and its downscaled renditions with the given sizes to YUV
+ * images. The images in the returned frame are \c nullptr if the conversion fails.
+ *
+ * This function can be called from multiple threads simultaneously.
+ */
+KDynamicWallpaperWriterFrame KDynamicWallpaperWriterPrivate::convertFrame(const QImage &image, avifPixelFormat pixelFormat,
+                                                                          const QVector<QSize> &renditionSizes)
 {
-    const QByteArray xmp = serializeMetaData(metaData);
-    avifEncoder *encoder = avifEncoderCreate();
+    KDynamicWallpaperWriterFrame frame;
+    frame.image = convert(image, pixelFormat);
+
+    frame.renditions.reserve(renditionSizes.count());
+    for (const QSize &size : renditionSizes) {
+        const QImage scaledImage = image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        frame.renditions.append(convert(scaledImage, pixelFormat));
+    }
+
+    return frame;
+}
+
+void KDynamicWallpaperWriterPrivate::destroyFrame(const KDynamicWallpaperWriterFrame &frame)
+{
+    if (frame.image)
+        avifImageDestroy(frame.image);
+    for (avifImage *rendition : frame.renditions) {
+        if (rendition)
+            avifImageDestroy(rendition);
+    }
+}
+
+bool KDynamicWallpaperWriterPrivate::begin(QIODevice *device, bool isDeviceForeign)
+{
+    if (encoder)
+        abort();
+
+    this->device = device;
+    this->isDeviceForeign = isDeviceForeign;
+
+    if (device->isOpen()) {
+        if (!(device->openMode() & QIODevice::WriteOnly)) {
+            setError(KDynamicWallpaperWriter::DeviceError, QStringLiteral("The device is not open for writing"));
+            abort();
+            return false;
+        }
+    } else {
+        if (!device->open(QIODevice::WriteOnly)) {
+            setError(KDynamicWallpaperWriter::DeviceError, device->errorString());
+            abort();
+            return false;
+        }
+    }
+
+    wallpaperWriterError = KDynamicWallpaperWriter::NoError;
+    errorString.clear();
+    encodedImageCount = 0;
+    initialXmp.clear();
+    hasRenditions = false;
+
+    // The images can't be encoded until it's known whether the wallpaper is in the cache.
+    isCaching = !cacheDirectory.isEmpty();
+    if (isCaching) {
+        contentHash.reset();
+        KDynamicWallpaperEncodeCache::addOptions(&contentHash, encoderOptions);
+    }
+
+    encoder = avifEncoderCreate();
     encoder->maxThreads = QThread::idealThreadCount();
 
-    QList<avifImage *> avifImages;
-    for (const QImage &image : images) {
-        avifImage *avif = avifImageCreate(image.width(), image.height(), 8, AVIF_PIXEL_FORMAT_YUV444);
-        avifImageSetMetadataXMP(avif, reinterpret_cast<const uint8_t *>(xmp.constData()), xmp.size());
+    if (!configureEncoder(encoder)) {
+        abort();
+        return false;
+    }
 
-        avifRGBImage rgb;
-        avifRGBImageSetDefaults(&rgb, avif);
+    return true;
+}
 
-        rgb.format = AVIF_RGB_FORMAT_RGB;
-        rgb.depth = 8;
-        rgb.rowBytes = image.bytesPerLine();
-        rgb.pixels = const_cast<uint8_t *>(image.constBits());
+/*!
+ * \internal
+ *
+ * Applies the encoder options to the specified \p encoder. Returns \c false if the options are
+ * invalid or the requested codec is not available.
+ */
+bool KDynamicWallpaperWriterPrivate::configureEncoder(avifEncoder *encoder)
+{
+    if (!encoderOptions.isValid()) {
+        setError(KDynamicWallpaperWriter::EncoderError, QStringLiteral("Invalid encoder options"));
+        return false;
+    }
+
+    if (const char *name = codecName(encoderOptions.codec())) {
+        const avifCodecChoice codecChoice = avifCodecChoiceFromName(name);
+        if (codecChoice == AVIF_CODEC_CHOICE_AUTO || !avifCodecName(codecChoice, AVIF_CODEC_FLAG_CAN_ENCODE)) {
+            setError(KDynamicWallpaperWriter::EncoderError,
+                     QStringLiteral("The %1 encoder is not available").arg(QString::fromLatin1(name)));
+            return false;
+        }
+        encoder->codecChoice = codecChoice;
+    }
 
-        // TODO: color space
+    if (encoderOptions.speed() != KDynamicWallpaperEncoderOptions::DefaultSpeed)
+        encoder->speed = encoderOptions.speed();
+    encoder->minQuantizer = encoderOptions.minQuantizer();
+    encoder->maxQuantizer = encoderOptions.maxQuantizer();
+    encoder->tileRowsLog2 = encoderOptions.tileRowsLog2();
+    encoder->tileColsLog2 = encoderOptions.tileColumnsLog2();
 
-        avifResult result = avifImageRGBToYUV(avif, &rgb);
-        if (result != AVIF_RESULT_OK) {
-            avifImageDestroy(avif);
+    return true;
+}
+
+/*!
+ * \internal
+ *
+ * Creates an encoder for every rendition that is smaller than images of the specified
+ * \p imageSize. All images in a wallpaper have the same size, so this is done only once.
+ */
+bool KDynamicWallpaperWriterPrivate::createRenditions(const QSize &imageSize)
+{
+    hasRenditions = true;
+
+    const QVector<QSize> renditionSizes = encoderOptions.renditionSizes();
+    for (const QSize &renditionSize : renditionSizes) {
+        const QSize size = imageSize.scaled(renditionSize, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+        if (size.width() >= imageSize.width() || size.height() >= imageSize.height())
             continue;
+        const bool isDuplicate = std::any_of(renditions.constBegin(), renditions.constEnd(),
+                                             [&size](const KDynamicWallpaperWriterRendition &rendition) {
+                                                 return rendition.size == size;
+                                             });
+        if (isDuplicate)
+            continue;
+
+        KDynamicWallpaperWriterRendition rendition;
+        rendition.size = size;
+        rendition.encoder = avifEncoderCreate();
+        rendition.encoder->maxThreads = QThread::idealThreadCount();
+        renditions.append(rendition);
+
+        if (!configureEncoder(rendition.encoder))
+            return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \internal
+ *
+ * Schedules the color conversion of the given \p image on the thread pool. The oldest pending
+ * image is encoded if too many images are waiting to be encoded.
+ */
+bool KDynamicWallpaperWriterPrivate::addImage(const QImage &image)
+{
+    if (!hasRenditions && !createRenditions(image.size()))
+        return false;
+
+    QVector<QSize> renditionSizes;
+    renditionSizes.reserve(renditions.count());
+    for (const KDynamicWallpaperWriterRendition &rendition : qAsConst(renditions))
+        renditionSizes.append(rendition.size);
+
+    const avifPixelFormat pixelFormat = pixelFormatForChromaSubsampling(encoderOptions.chromaSubsampling());
+    pendingImages.enqueue(QtConcurrent::run(&KDynamicWallpaperWriterPrivate::convertFrame, image, pixelFormat, renditionSizes));
+    if (pendingImages.count() > maxPendingImages(image.size()))
+        return encodePendingImage();
+    return true;
+}
+
+/*!
+ * \internal
+ *
+ * Adds the specified \p source with the contents \p image to the write sequence. If the cache
+ * is in use, the image is only hashed, and it's encoded in finish() if the cache has no
+ * matching wallpaper; otherwise the image is encoded right away.
+ */
+bool KDynamicWallpaperWriterPrivate::addSource(const KDynamicWallpaperWriterSource &source, const QImage &image)
+{
+    if (!isCaching)
+        return addImage(image);
+
+    KDynamicWallpaperEncodeCache::addImage(&contentHash, image);
+    sources.append(source);
+    return true;
+}
+
+/*!
+ * \internal
+ *
+ * Encodes the images whose encoding has been put off because the cache was in use. Images that
+ * were added as files are loaded again, so they don't have to be kept in memory meanwhile.
+ */
+bool KDynamicWallpaperWriterPrivate::encodeSources()
+{
+    for (KDynamicWallpaperWriterSource &source : sources) {
+        QImage image = source.image;
+        source.image = QImage();
+        if (image.isNull())
+            image = QImage(source.fileName);
+        if (image.isNull()) {
+            setError(KDynamicWallpaperWriter::DeviceError, QStringLiteral("Failed to load %1").arg(source.fileName));
+            return false;
         }
+        if (!addImage(image))
+            return false;
+    }
+
+    sources.clear();
+    return true;
+}
+
+bool KDynamicWallpaperWriterPrivate::encodePendingImage()
+{
+    const KDynamicWallpaperWriterFrame frame = pendingImages.dequeue().result();
+    auto cleanup = qScopeGuard([&frame]() {
+        destroyFrame(frame);
+    });
+
+    avifImage *avif = frame.image;
+    if (!avif || frame.renditions.contains(nullptr)) {
+        setError(KDynamicWallpaperWriter::EncoderError,
+                 QStringLiteral("Failed to convert image %1 to YUV").arg(encodedImageCount));
+        return false;
+    }
 
-        result = avifEncoderAddImage(encoder, avif, 0, AVIF_ADD_IMAGE_FLAG_NONE);
+    // The metadata of the image sequence is taken from the first frame. If not all metadata is
+    // known at this point, the XMP packet will be replaced when the sequence is finished.
+    if (encodedImageCount == 0) {
+        initialXmp = KDynamicWallpaperXmp::serialize(metaData);
+        avifImageSetMetadataXMP(avif, reinterpret_cast<const uint8_t *>(initialXmp.constData()), initialXmp.size());
+    }
+
+    // The renditions get the same key frames, so they can be remuxed along with the images.
+    const int keyFrameInterval = encoderOptions.keyFrameInterval();
+    uint32_t flags = AVIF_ADD_IMAGE_FLAG_NONE;
+    if (keyFrameInterval > 0 && encodedImageCount % keyFrameInterval == 0)
+        flags |= AVIF_ADD_IMAGE_FLAG_FORCE_KEYFRAME;
+
+    // The encoder keeps only the compressed frame, so the YUV images are released right away.
+    avifResult result = avifEncoderAddImage(encoder, avif, 0, flags);
+    if (result != AVIF_RESULT_OK) {
+        setError(KDynamicWallpaperWriter::EncoderError, avifResultToString(result));
+        return false;
+    }
+
+    for (int i = 0; i < renditions.count(); ++i) {
+        result = avifEncoderAddImage(renditions[i].encoder, frame.renditions[i], 0, flags);
         if (result != AVIF_RESULT_OK) {
-            avifImageDestroy(avif);
-            continue;
+            setError(KDynamicWallpaperWriter::EncoderError, avifResultToString(result));
+            return false;
         }
+    }
 
-        avifImages.append(avif);
+    encodedImageCount++;
+    return true;
+}
+
+/*!
+ * \internal
+ *
+ * Encodes the remaining pending images and appends the encoder output to \p outputs, the
+ * full-size images first and then the renditions, if any. The caller must free the outputs.
+ */
+bool KDynamicWallpaperWriterPrivate::finishEncoding(QVector<avifRWData> *outputs)
+{
+    while (!pendingImages.isEmpty()) {
+        if (!encodePendingImage())
+            return false;
     }
 
-    avifRWData output = AVIF_DATA_EMPTY;
-    avifResult result = avifEncoderFinish(encoder, &output);
-    if (result == AVIF_RESULT_OK) {
-        device->write(reinterpret_cast<const char *>(output.data), output.size);
-    } else {
-        wallpaperWriterError = KDynamicWallpaperWriter::EncoderError;
-        errorString = avifResultToString(result);
+    outputs->append(AVIF_DATA_EMPTY);
+    avifResult result = avifEncoderFinish(encoder, &outputs->last());
+    if (result != AVIF_RESULT_OK) {
+        setError(KDynamicWallpaperWriter::EncoderError, avifResultToString(result));
+        return false;
+    }
+
+    for (const KDynamicWallpaperWriterRendition &rendition : qAsConst(renditions)) {
+        outputs->append(AVIF_DATA_EMPTY);
+        result = avifEncoderFinish(rendition.encoder, &outputs->last());
+        if (result != AVIF_RESULT_OK) {
+            setError(KDynamicWallpaperWriter::EncoderError, avifResultToString(result));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static QByteArray wrapOutput(const avifRWData &output)
+{
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(output.data), output.size);
+}
+
+bool KDynamicWallpaperWriterPrivate::finish()
+{
+    auto cleanup = qScopeGuard([this]() {
+        abort();
+    });
+
+    const KDynamicWallpaperMetaDataTable table(metaData);
+    const QByteArray xmp = KDynamicWallpaperXmp::serialize(table);
+    const QByteArray cbor = KDynamicWallpaperCbor::serialize(table);
+    QByteArray key;
+
+    if (isCaching) {
+        key = contentHash.result().toHex();
+        QByteArray data = KDynamicWallpaperEncodeCache::load(cacheDirectory, key);
+        if (!data.isEmpty()) {
+            // The cached wallpaper may have been written with different metadata.
+            if (!KDynamicWallpaperIsoBmff::replaceMetaData(&data, xmp)) {
+                setError(KDynamicWallpaperWriter::EncoderError, QStringLiteral("Failed to store the metadata"));
+                return false;
+            }
+            KDynamicWallpaperIsoBmff::replaceMetaDataBox(&data, cbor);
+            return write({data});
+        }
+        if (!encodeSources())
+            return false;
+    }
+
+    QVector<avifRWData> outputs;
+    auto freeOutputs = qScopeGuard([&outputs]() {
+        for (avifRWData &output : outputs)
+            avifRWDataFree(&output);
+    });
+
+    if (!finishEncoding(&outputs))
+        return false;
+
+    // The encoded wallpaper is written straight from the encoder buffers, which can take up
+    // hundreds of megabytes, rather than being assembled in another buffer first.
+    QByteArrayList parts;
+    parts.append(wrapOutput(outputs[0]));
+    for (int i = 0; i < renditions.count(); ++i) {
+        const avifRWData &output = outputs[i + 1];
+        parts.append(KDynamicWallpaperIsoBmff::makeRenditionHeader(renditions[i].size, encodedImageCount, output.size));
+        parts.append(wrapOutput(output));
+    }
+
+    // Failing to fill the cache only makes the next write slower.
+    if (isCaching)
+        KDynamicWallpaperEncodeCache::store(cacheDirectory, key, parts);
+
+    if (xmp != initialXmp) {
+        const qint64 fileSize = std::accumulate(parts.constBegin(), parts.constEnd(), qint64(0),
+                                                [](qint64 size, const QByteArray &part) {
+                                                    return size + part.size();
+                                                });
+        QByteArray appendix;
+        if (!KDynamicWallpaperIsoBmff::replaceMetaData(reinterpret_cast<char *>(outputs[0].data), outputs[0].size,
+                                                       fileSize, xmp, &appendix)) {
+            setError(KDynamicWallpaperWriter::EncoderError, QStringLiteral("Failed to store the metadata"));
+            return false;
+        }
+        parts.append(appendix);
+    }
+
+    parts.append(KDynamicWallpaperIsoBmff::makeMetaDataBox(cbor));
+
+    return write(parts);
+}
+
+/*!
+ * \internal
+ *
+ * Writes the encoded wallpaper, which consists of the concatenated \p parts, to the device.
+ */
+bool KDynamicWallpaperWriterPrivate::write(const QByteArrayList &parts)
+{
+    for (const QByteArray &data : parts) {
+        for (int offset = 0; offset < data.size(); offset += s_chunkSize) {
+            const int chunkSize = std::min(s_chunkSize, data.size() - offset);
+            if (device->write(data.constData() + offset, chunkSize) != chunkSize) {
+                setError(KDynamicWallpaperWriter::DeviceError, device->errorString());
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \internal
+ *
+ * Discards the pending images and the encoder state, and releases the device.
+ */
+void KDynamicWallpaperWriterPrivate::abort()
+{
+    while (!pendingImages.isEmpty())
+        destroyFrame(pendingImages.dequeue().result());
+
+    sources.clear();
+
+    for (const KDynamicWallpaperWriterRendition &rendition : qAsConst(renditions))
+        avifEncoderDestroy(rendition.encoder);
+    renditions.clear();
+    hasRenditions = false;
+
+    if (encoder) {
+        avifEncoderDestroy(encoder);
+        encoder = nullptr;
     }
 
-    avifRWDataFree(&output);
-    avifEncoderDestroy(encoder);
-    for (avifImage *image : avifImages)
-        avifImageDestroy(image);
+    if (device && !isDeviceForeign)
+        delete device;
+    device = nullptr;
+    isDeviceForeign = false;
 }
 
 /*!
@@ -121,10 +629,11 @@ KDynamicWallpaperWriter::KDynamicWallpaperWriter()
 }
 
 /*!
- * Destructs the KDynamicWallpaperWriter object.
+ * Destructs the KDynamicWallpaperWriter object. An unfinished write sequence is discarded.
  */
 KDynamicWallpaperWriter::~KDynamicWallpaperWriter()
 {
+    d->abort();
 }
 
 void KDynamicWallpaperWriter::setMetaData(const QList<KDynamicWallpaperMetaData> &metaData)
@@ -137,14 +646,15 @@ QList<KDynamicWallpaperMetaData> KDynamicWallpaperWriter::metaData() const
     return d->metaData;
 }
 
+/*!
+ * Sets the images that will be written by flush() to \p images.
+ *
+ * The images are converted to the pixel format of the encoder one at a time while they are
+ * being written, so no converted copies are kept around.
+ */
 void KDynamicWallpaperWriter::setImages(const QList<QImage> &images)
 {
-    QList<QImage> tmpImages;
-    tmpImages.reserve(images.count());
-    for (const QImage &image : images)
-        tmpImages.append(image.convertToFormat(QImage::Format_RGB888));
-
-    d->images = tmpImages;
+    d->images = images;
 }
 
 QList<QImage> KDynamicWallpaperWriter::images() const
@@ -153,52 +663,204 @@ QList<QImage> KDynamicWallpaperWriter::images() const
 }
 
 /*!
- * Begins a write sequence to the device and returns \c true if successful; otherwise \c false is
- * returned. You must call this method before calling write() method.
+ * Sets the options that control how the images are encoded to \p options.
+ *
+ * The options take effect the next time flush() or begin() is called.
+ */
+void KDynamicWallpaperWriter::setEncoderOptions(const KDynamicWallpaperEncoderOptions &options)
+{
+    d->encoderOptions = options;
+}
+
+/*!
+ * Returns the options that control how the images are encoded.
+ */
+KDynamicWallpaperEncoderOptions KDynamicWallpaperWriter::encoderOptions() const
+{
+    return d->encoderOptions;
+}
+
+/*!
+ * Sets the directory where encoded wallpapers are cached to \p directory. An empty string,
+ * which is the default, disables the cache.
+ *
+ * When the cache is in use, the images added between begin() and finish() are only hashed at
+ * first, and they are encoded in finish() if there is no cached wallpaper with the same images
+ * and encoder options. Images added with addImage() are kept in memory until then, so prefer
+ * addImageFile() when writing a lot of images.
+ */
+void KDynamicWallpaperWriter::setCacheDirectory(const QString &directory)
+{
+    d->cacheDirectory = directory;
+}
+
+/*!
+ * Returns the directory where encoded wallpapers are cached, or an empty string if the cache
+ * is disabled.
+ */
+QString KDynamicWallpaperWriter::cacheDirectory() const
+{
+    return d->cacheDirectory;
+}
+
+/*!
+ * Writes the images and the metadata to the device and returns \c true if successful;
+ * otherwise \c false is returned.
  *
  * If the device is not already open, KDynamicWallpaperWriter will attempt to open the device
  * in QIODevice::WriteOnly mode by calling open().
+ *
+ * \sa begin()
  */
 bool KDynamicWallpaperWriter::flush(QIODevice *device)
 {
-    if (device->isOpen()) {
-        if (!(device->openMode() & QIODevice::WriteOnly)) {
-            d->wallpaperWriterError = KDynamicWallpaperWriter::DeviceError;
-            d->errorString = QStringLiteral("The device is not open for writing");
-            return false;
-        }
-    } else {
-        if (!device->open(QIODevice::WriteOnly)) {
-            d->wallpaperWriterError = KDynamicWallpaperWriter::DeviceError;
-            d->errorString = device->errorString();
+    if (!d->begin(device, true))
+        return false;
+
+    for (const QImage &image : qAsConst(d->images)) {
+        if (!d->addSource(KDynamicWallpaperWriterSource{QString(), image}, image)) {
+            d->abort();
             return false;
         }
     }
 
-    d->flush(device);
-    return true;
+    return d->finish();
 }
 
 /*!
- * Begins a write sequence to the file \p fileName and returns \c true if successful; otherwise
- * \c false is returned. Internally, KDynamicWallpaperWriter will create a QFile object and open
- * it in QIODevice::WriteOnly mode, and use it when writing dynamic wallpapers.
- *
- * You must call this method before calling write() method.
+ * Writes the images and the metadata to the file \p fileName and returns \c true if
+ * successful; otherwise \c false is returned. Internally, KDynamicWallpaperWriter will create
+ * a QFile object and open it in QIODevice::WriteOnly mode, and use it when writing dynamic
+ * wallpapers.
  */
 bool KDynamicWallpaperWriter::flush(const QString &fileName)
 {
     QFile file(fileName);
-    if (!file.open(QIODevice::WriteOnly)) {
-        d->wallpaperWriterError = KDynamicWallpaperWriter::DeviceError;
-        d->errorString = file.errorString();
+    return flush(&file);
+}
+
+/*!
+ * Begins an incremental write sequence to the device and returns \c true if successful;
+ * otherwise \c false is returned.
+ *
+ * Unlike flush(), the write sequence doesn't need all images to be loaded in advance. Each
+ * image passed to addImage() is converted and encoded as it arrives, and released right away,
+ * so the memory usage doesn't grow with the number of images. Call finish() to write the
+ * wallpaper to the device.
+ *
+ * The images and the metadata set with setImages() and setMetaData() are discarded.
+ *
+ * If the device is not already open, KDynamicWallpaperWriter will attempt to open the device
+ * in QIODevice::WriteOnly mode by calling open().
+ */
+bool KDynamicWallpaperWriter::begin(QIODevice *device)
+{
+    d->images.clear();
+    d->metaData.clear();
+    return d->begin(device, true);
+}
+
+/*!
+ * Begins an incremental write sequence to the file \p fileName and returns \c true if
+ * successful; otherwise \c false is returned.
+ *
+ * \sa begin(QIODevice *)
+ */
+bool KDynamicWallpaperWriter::begin(const QString &fileName)
+{
+    d->images.clear();
+    d->metaData.clear();
+    return d->begin(new QFile(fileName), false);
+}
+
+/*!
+ * Adds the specified \p image to the current write sequence and returns \c true if successful;
+ * otherwise \c false is returned.
+ */
+bool KDynamicWallpaperWriter::addImage(const QImage &image)
+{
+    if (!d->encoder) {
+        d->setError(KDynamicWallpaperWriter::UnknownError, QStringLiteral("No write sequence"));
+        return false;
+    }
+
+    if (!d->addSource(KDynamicWallpaperWriterSource{QString(), image}, image)) {
+        d->abort();
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * Adds the specified \p image with the metadata \p metaData to the current write sequence and
+ * returns \c true if successful; otherwise \c false is returned.
+ *
+ * The index of the metadata is set to the index of the image.
+ */
+bool KDynamicWallpaperWriter::addImage(const QImage &image, const KDynamicWallpaperMetaData &metaData)
+{
+    const int imageIndex = d->encodedImageCount + d->pendingImages.count() + d->sources.count();
+    if (!addImage(image))
+        return false;
+
+    KDynamicWallpaperMetaData indexedMetaData = metaData;
+    indexedMetaData.setIndex(imageIndex);
+    d->metaData.append(indexedMetaData);
+
+    return true;
+}
+
+/*!
+ * Loads the image from the file \p fileName and adds it to the current write sequence. Returns
+ * \c true if successful; otherwise \c false is returned.
+ *
+ * Unlike addImage(), the image doesn't have to stay in memory while the cache is in use.
+ */
+bool KDynamicWallpaperWriter::addImageFile(const QString &fileName)
+{
+    if (!d->encoder) {
+        d->setError(KDynamicWallpaperWriter::UnknownError, QStringLiteral("No write sequence"));
+        return false;
+    }
+
+    const QImage image(fileName);
+    if (image.isNull()) {
+        d->setError(KDynamicWallpaperWriter::DeviceError, QStringLiteral("Failed to load %1").arg(fileName));
+        d->abort();
+        return false;
+    }
+
+    if (!d->addSource(KDynamicWallpaperWriterSource{fileName, QImage()}, image)) {
+        d->abort();
         return false;
     }
 
-    d->flush(&file);
     return true;
 }
 
+/*!
+ * Adds the metadata \p metaData to the current write sequence. This can be used to make
+ * several metadata entries refer to the same image.
+ */
+void KDynamicWallpaperWriter::addMetaData(const KDynamicWallpaperMetaData &metaData)
+{
+    d->metaData.append(metaData);
+}
+
+/*!
+ * Finishes the current write sequence and writes the wallpaper to the device. Returns \c true
+ * if successful; otherwise \c false is returned.
+ */
+bool KDynamicWallpaperWriter::finish()
+{
+    if (!d->encoder) {
+        d->setError(KDynamicWallpaperWriter::UnknownError, QStringLiteral("No write sequence"));
+        return false;
+    }
+    return d->finish();
+}
+
 /*!
  * Returns the type of the last error that occurred.
  */
@@ -10,8 +10,10 @@
 
 #include <QIODevice>
 
+class KDynamicWallpaperEncoderOptions;
 class KDynamicWallpaperMetaData;
 class KDynamicWallpaperWriterPrivate;
+class QImage;
 
 class KDYNAMICWALLPAPER_EXPORT KDynamicWallpaperWriter
 {
@@ -32,9 +34,23 @@ public:
     void setImages(const QList<QImage> &images);
     QList<QImage> images() const;
 
+    void setEncoderOptions(const KDynamicWallpaperEncoderOptions &options);
+    KDynamicWallpaperEncoderOptions encoderOptions() const;
+
+    void setCacheDirectory(const QString &directory);
+    QString cacheDirectory() const;
+
     bool flush(QIODevice *device);
     bool flush(const QString &fileName);
 
+    bool begin(QIODevice *device);
+    bool begin(const QString &fileName);
+    bool addImage(const QImage &image);
+    bool addImage(const QImage &image, const KDynamicWallpaperMetaData &metaData);
+    bool addImageFile(const QString &fileName);
+    void addMetaData(const KDynamicWallpaperMetaData &metaData);
+    bool finish();
+
     WallpaperWriterError error() const;
     QString errorString() const;
 
@@ -0,0 +1,76 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "kdynamicwallpaperxmp_p.h"
+#include "kdynamicwallpapermetadata.h"
+#include "kdynamicwallpapermetadatatable.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QXmlStreamReader>
+
+/*!
+ * \internal
+ *
+ * Extracts the dynamic wallpaper metadata from the specified XMP packet \p xmp.
+ *
+ * The packet is scanned with a streaming reader, which stops as soon as the attribute with
+ * the metadata has been found, rather than building a DOM tree of the whole packet.
+ *
+ * Returns an empty table if the packet contains no valid dynamic wallpaper metadata.
+ */
+KDynamicWallpaperMetaDataTable KDynamicWallpaperXmp::parse(const QByteArray &xmp)
+{
+    const QString attributeName = QStringLiteral("plasma:dynamic-wallpaper-solar");
+
+    QXmlStreamReader reader(xmp);
+    while (!reader.atEnd()) {
+        if (reader.readNext() != QXmlStreamReader::StartElement)
+            continue;
+        if (reader.qualifiedName() != QLatin1String("rdf:Description"))
+            continue;
+
+        const QStringRef base64 = reader.attributes().value(attributeName);
+        if (base64.isEmpty())
+            continue;
+
+        const QJsonArray array = QJsonDocument::fromJson(QByteArray::fromBase64(base64.toLatin1())).array();
+        return KDynamicWallpaperMetaDataTable::fromJson(array);
+    }
+
+    return KDynamicWallpaperMetaDataTable();
+}
+
+/*!
+ * \internal
+ *
+ * Creates an XMP packet that stores the specified dynamic wallpaper metadata \p table.
+ */
+QByteArray KDynamicWallpaperXmp::serialize(const KDynamicWallpaperMetaDataTable &table)
+{
+    QJsonDocument document;
+    document.setArray(table.toJson());
+
+    const QByteArray base64 = document.toJson(QJsonDocument::Compact).toBase64();
+    QFile templateFile(QStringLiteral(":/kdynamicwallpaper/xmp/metadata.xml"));
+    templateFile.open(QFile::ReadOnly);
+
+    QByteArray xmp = templateFile.readAll();
+    xmp.replace(QByteArrayLiteral("base64"), base64);
+    return xmp;
+}
+
+/*!
+ * \internal
+ *
+ * Creates an XMP packet that stores the specified dynamic wallpaper metadata \p metaData.
+ * Invalid metadata is left out.
+ */
+QByteArray KDynamicWallpaperXmp::serialize(const QList<KDynamicWallpaperMetaData> &metaData)
+{
+    return serialize(KDynamicWallpaperMetaDataTable(metaData));
+}
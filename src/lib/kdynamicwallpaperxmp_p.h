@@ -0,0 +1,21 @@
+/*
+ * SPDX-FileCopyrightText: 2020 Vlad Zahorodnii <vlad.zahorodnii@kde.org>
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+
+class KDynamicWallpaperMetaData;
+class KDynamicWallpaperMetaDataTable;
+
+class KDynamicWallpaperXmp
+{
+public:
+    static KDynamicWallpaperMetaDataTable parse(const QByteArray &xmp);
+    static QByteArray serialize(const KDynamicWallpaperMetaDataTable &table);
+    static QByteArray serialize(const QList<KDynamicWallpaperMetaData> &metaData);
+};
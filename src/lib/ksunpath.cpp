@@ -7,7 +7,7 @@
 #include "ksunpath.h"
 #include "ksunposition.h"
 
-#include <QVector>
+#include <QtMath>
 
 #include <cmath>
 
@@ -22,59 +22,34 @@ static QVector3D computeNormal(const QVector3D &center, const QVector3D &v1, con
     return cross.normalized();
 }
 
-static QVector3D positionToVector(const KSunPosition &position)
-{
-    return position.toVector();
-}
-
 /*!
  * Creates a path of the Sun at the specified date and location.
+ *
+ * The Sun travels along a circle of constant declination around the celestial pole. In the
+ * local coordinate system used by KSunPosition::toVector(), where the x axis points north, the
+ * y axis points east, and the z axis points up, the celestial pole is elevated above the
+ * northern horizon by the latitude of the observer. The path is a circle of radius cos(δ) in
+ * the plane perpendicular to the pole, centered at sin(δ) along the pole, where δ is the
+ * declination of the Sun.
+ *
+ * Unlike KSunPosition, the path doesn't account for the atmospheric refraction. The difference
+ * between the two is negligible except for a narrow band near the horizon.
  */
 KSunPath KSunPath::create(const QDateTime &dateTime, const QGeoCoordinate &location)
 {
-    // I bet there is a nice formula to determine the normal and the center of
-    // the sun path. Sampling the position of the Sun is not that bad, however
-    // having the computed results as accurate as possible is still something we
-    // have to strive for.
-    const int sampleCount = 24;
-
-    const QDateTime utcDateTime = dateTime.toUTC();
-    const QDate utcDate = utcDateTime.date();
-
-    QVector<KSunPosition> positions;
-    positions.reserve(sampleCount);
-
-    for (int i = 0; i < sampleCount; ++i) {
-        const QTime utcTime(i, 0);
-        const QDateTime sampleDataTime(utcDate, utcTime, Qt::UTC);
-        const KSunPosition position(sampleDataTime, location);
-        if (!position.isValid())
-            return KSunPath();
-        positions << position;
-    }
-
-    QVector<QVector3D> samples;
-    samples.reserve(sampleCount);
-    std::transform(positions.constBegin(), positions.constEnd(),
-                   std::back_inserter(samples), positionToVector);
+    if (!location.isValid())
+        return KSunPath();
 
-    QVector3D center = std::accumulate(samples.constBegin(), samples.constEnd(), QVector3D());
-    center /= sampleCount;
+    // The declination changes by less than half a degree a day, take it at the middle of the day.
+    const QDateTime noon(dateTime.toUTC().date(), QTime(12, 0), Qt::UTC);
+    const qreal declination = qDegreesToRadians(KSunPosition::declination(noon));
+    const qreal latitude = qDegreesToRadians(location.latitude());
 
-    float radius = 0;
-    for (const QVector3D &sample : samples)
-        radius += (sample - center).length();
-    radius /= sampleCount;
+    const QVector3D pole(std::cos(latitude), 0, std::sin(latitude));
+    const QVector3D center = pole * std::sin(declination);
+    const float radius = std::cos(declination);
 
-    QVector3D normal;
-    for (int i = 1; i < samples.count(); ++i) {
-        const QVector3D v1 = samples.at(i - 1);
-        const QVector3D v2 = samples.at(i);
-        normal += computeNormal(center, v1, v2);
-    }
-    normal.normalize();
-
-    return KSunPath(center, normal, radius);
+    return KSunPath(center, pole, radius);
 }
 
 /*!
@@ -111,6 +86,14 @@ QVector3D KSunPath::normal() const
     return m_normal;
 }
 
+/*!
+ * Returns the radius of this path of the Sun.
+ */
+float KSunPath::radius() const
+{
+    return m_radius;
+}
+
 /*!
  * Projects the specified KSunPosition onto this KSunPath.
  */
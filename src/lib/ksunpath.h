@@ -22,6 +22,7 @@ public:
     bool isValid() const;
     QVector3D center() const;
     QVector3D normal() const;
+    float radius() const;
 
     QVector3D project(const KSunPosition &position) const;
 
@@ -32,5 +33,5 @@ private:
 
     QVector3D m_center;
     QVector3D m_normal;
-    float m_radius;
+    float m_radius = 0;
 };
@@ -8,6 +8,9 @@
 
 #include <QtMath>
 
+#include <cmath>
+#include <limits>
+
 /*!
  * \class KSunPosition
  * \brief The KSunPosition class provides a convenient way for determining the position of the
@@ -279,6 +282,90 @@ KSunPosition KSunPosition::midnight(const QDateTime &dateTime, const QGeoCoordin
     return position;
 }
 
+/*!
+ * Returns the declination of the Sun at the specified date \p dateTime, in decimal degrees.
+ *
+ * The declination is the angle between the direction to the Sun and the celestial equator.
+ * It is positive when the Sun is north of the equator.
+ */
+qreal KSunPosition::declination(const QDateTime &dateTime)
+{
+    const qreal jcent = julianDayToJulianCenturies(dateTimeToJulianDay(dateTime));
+    return qRadiansToDegrees(solarDeclination(jcent));
+}
+
+/*!
+ * Computes the positions of the Sun at the specified times \p epochSeconds and location
+ * \p location. The times are given as the number of seconds since 1970-01-01T00:00:00 UTC.
+ *
+ * This is much faster than constructing a KSunPosition for every time. The declination of the
+ * Sun and the equation of time are evaluated only at the UTC midnights around the given times
+ * and interpolated in between, the rest is computed in plain loops over the times.
+ */
+QVector<KSunPosition> KSunPosition::compute(const QVector<qint64> &epochSeconds, const QGeoCoordinate &location)
+{
+    const int count = epochSeconds.count();
+    const qreal latitude = location.latitude();
+    const qreal sinLatitude = sind(latitude);
+    const qreal cosLatitude = cosd(latitude);
+
+    QVector<qreal> hourAngles(count);
+    QVector<qreal> declinations(count);
+
+    qint64 cachedDay = std::numeric_limits<qint64>::min();
+    qreal startDeclination = 0;
+    qreal endDeclination = 0;
+    qreal startEquation = 0;
+    qreal endEquation = 0;
+
+    for (int i = 0; i < count; ++i) {
+        qint64 day = epochSeconds[i] / 86400;
+        if (epochSeconds[i] % 86400 < 0)
+            --day;
+
+        if (day != cachedDay) {
+            const qreal startJcent = julianDayToJulianCenturies(day + 2440587.5);
+            const qreal endJcent = julianDayToJulianCenturies(day + 2440588.5);
+            startDeclination = solarDeclination(startJcent);
+            endDeclination = solarDeclination(endJcent);
+            startEquation = equationOfTime(startJcent);
+            endEquation = equationOfTime(endJcent);
+            cachedDay = day;
+        }
+
+        const qreal fraction = (epochSeconds[i] - day * 86400) / 86400.0;
+        const qreal equation = startEquation + (endEquation - startEquation) * fraction;
+        declinations[i] = startDeclination + (endDeclination - startDeclination) * fraction;
+
+        const qreal angle = std::fmod(location.longitude() + (equation + fraction * 1440 - 720) / 4, 360);
+        hourAngles[i] = angle < -180 ? angle + 360 : (angle > 180 ? angle - 360 : angle);
+    }
+
+    QVector<KSunPosition> positions(count);
+
+    for (int i = 0; i < count; ++i) {
+        const qreal sinDeclination = std::sin(declinations[i]);
+        const qreal cosDeclination = std::cos(declinations[i]);
+        const qreal hourAngle = hourAngles[i];
+
+        const qreal cosZenith = sinLatitude * sinDeclination + cosLatitude * cosDeclination * cosd(hourAngle);
+        const qreal zenith = std::acos(cosZenith);
+        const qreal elevation = 90 - qRadiansToDegrees(zenith);
+
+        qreal azimuth = std::nan("");
+        const qreal denominator = cosLatitude * std::sin(zenith);
+        if (!qFuzzyIsNull(denominator)) {
+            const qreal numerator = sinLatitude * cosZenith - sinDeclination;
+            azimuth = std::acos(qBound(-1.0, numerator / denominator, 1.0));
+            azimuth = qRadiansToDegrees(hourAngle < 0 ? M_PI - azimuth : azimuth + M_PI);
+        }
+
+        positions[i] = KSunPosition(elevation + atmosphericRefractionCorrection(elevation), azimuth);
+    }
+
+    return positions;
+}
+
 void KSunPosition::init(qreal jcent, const QGeoCoordinate &location, qreal hourAngle)
 {
     const qreal zenith = solarZenith(jcent, location, hourAngle);
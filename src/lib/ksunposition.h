@@ -11,6 +11,7 @@
 #include <QDateTime>
 #include <QGeoCoordinate>
 #include <QVector3D>
+#include <QVector>
 
 class KDYNAMICWALLPAPER_EXPORT KSunPosition
 {
@@ -25,6 +26,8 @@ public:
     QVector3D toVector() const;
 
     static KSunPosition midnight(const QDateTime &dateTime, const QGeoCoordinate &location);
+    static qreal declination(const QDateTime &dateTime);
+    static QVector<KSunPosition> compute(const QVector<qint64> &epochSeconds, const QGeoCoordinate &location);
 
 private:
     void init(qreal jcent, const QGeoCoordinate &location, qreal hourAngle);
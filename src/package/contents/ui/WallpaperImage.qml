@@ -50,6 +50,32 @@ Item {
         return Image.Null;
     }
 
+    /*!
+     * This property holds the size the layers are decoded at.
+     *
+     * The images are decoded at their native size if the fill mode doesn't scale them.
+     */
+    readonly property size __sourceSize: {
+        if (fillMode == Image.Pad || fillMode == Image.Tile)
+            return Qt.size(-1, -1);
+        if (width <= 0 || height <= 0)
+            return Qt.size(-1, -1);
+        return Qt.size(width, height);
+    }
+
+    /*!
+     * Returns the source url of a layer.
+     *
+     * With the PreserveAspectCrop fill mode, the image provider is asked to crop
+     * the layers to the aspect ratio of the item, so the parts of the images that
+     * are not visible are not decoded.
+     */
+    function __layerSource(layer) {
+        if (fillMode != Image.PreserveAspectCrop || layer == "")
+            return layer;
+        return layer + "#crop";
+    }
+
     Image {
         id: bottom
         anchors.fill: parent
@@ -57,7 +83,8 @@ Item {
         autoTransform: true
         cache: wallpaper.configuration.Cache
         fillMode: root.fillMode
-        source: root.bottomLayer
+        source: root.__layerSource(root.bottomLayer)
+        sourceSize: root.__sourceSize
     }
 
     Image {
@@ -68,7 +95,8 @@ Item {
         cache: wallpaper.configuration.Cache
         fillMode: root.fillMode
         opacity: root.blendFactor
-        source: root.topLayer
+        source: root.__layerSource(root.topLayer)
+        sourceSize: root.__sourceSize
     }
 
     Behavior on blendFactor {
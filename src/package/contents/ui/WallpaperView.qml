@@ -107,7 +107,9 @@ StackView {
             bottomLayer: bottomLayer,
             topLayer: topLayer,
             blendFactor: blendFactor,
-            fillMode: fillMode
+            fillMode: fillMode,
+            width: root.width,
+            height: root.height
         });
 
         if (root.__nextItem.status == Image.Loading)
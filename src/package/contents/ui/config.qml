@@ -19,7 +19,6 @@ ColumnLayout {
 
     property int cfg_FillMode
     property string cfg_Image
-    property alias cfg_UpdateInterval: updateIntervalSpinBox.value
     property alias cfg_AutoDetectLocation: autoDetectLocationCheckBox.checked
     property alias cfg_ManualLatitude: latitudeSpinBox.value
     property alias cfg_ManualLongitude: longitudeSpinBox.value
@@ -112,30 +111,6 @@ ColumnLayout {
             to: 180
             visible: !autoDetectLocationCheckBox.checked
         }
-
-        QtControls2.SpinBox {
-            id: updateIntervalSpinBox
-            Kirigami.FormData.label: i18nd("plasma_wallpaper_com.github.zzag.dynamic", "Update Every:")
-            to: minutesToMilliseconds(360)
-            from: minutesToMilliseconds(1)
-            stepSize: minutesToMilliseconds(1)
-
-            function millisecondsToMinutes(milliseconds) {
-                return milliseconds / 60000;
-            }
-            function minutesToMilliseconds(minutes) {
-                return minutes * 60000;
-            }
-
-            valueFromText: function(text, locale) {
-                return minutesToMilliseconds(Number.fromLocaleString(locale, text));
-            }
-            textFromValue: function(value, locale) {
-                const minutes = millisecondsToMinutes(value);
-                return minutes.toLocaleString(locale, 'f', 0) +
-                        i18ndp("plasma_wallpaper_com.github.zzag.dynamic", " minute", " minutes", minutes);
-            }
-        }
     }
 
     Kirigami.InlineMessage {
@@ -75,13 +75,6 @@ Item {
         onSystemClockChanged: handler.scheduleUpdate()
     }
 
-    Timer {
-        interval: wallpaper.configuration.UpdateInterval
-        repeat: true
-        running: handler.status == DynamicWallpaperHandler.Ready
-        onTriggered: handler.scheduleUpdate()
-    }
-
     Component.onCompleted: {
         wallpaper.loading = handler.status == DynamicWallpaperHandler.Ready;
     }
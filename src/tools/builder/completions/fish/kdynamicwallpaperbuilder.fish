@@ -5,6 +5,7 @@
 # SPDX-License-Identifier: CC0-1.0
 
 complete -f -c kdynamicwallpaperbuilder
+complete -c kdynamicwallpaperbuilder -n "__fish_use_subcommand" -a remux -d "Edit an existing wallpaper without encoding its images again"
 complete -c kdynamicwallpaperbuilder -s v -l version -d "Print the version information and quit"
 complete -c kdynamicwallpaperbuilder -s h -l help -d "Show help message and quit"
 complete -c kdynamicwallpaperbuilder -l help-all -d "Show help message including Qt specific options and quit"
@@ -13,3 +14,17 @@ complete -c kdynamicwallpaperbuilder -l quality -d "Specify the quality of the e
 complete -c kdynamicwallpaperbuilder -l output -d "Specify the file where the output will be written" -r
 complete -c kdynamicwallpaperbuilder -l discard-color-profile -d "Discard embedded color profile"
 complete -c kdynamicwallpaperbuilder -l lossless -d "Use lossless coding"
+complete -c kdynamicwallpaperbuilder -l speed -d "Specify the encoder speed preset (from 0 to 10)" -r
+complete -c kdynamicwallpaperbuilder -l min-quantizer -d "Specify the minimum quantizer (from 0 to 63)" -r
+complete -c kdynamicwallpaperbuilder -l max-quantizer -d "Specify the maximum quantizer (from 0 to 63)" -r
+complete -c kdynamicwallpaperbuilder -l tile-rows-log2 -d "Specify the base 2 logarithm of the number of tile rows" -r
+complete -c kdynamicwallpaperbuilder -l tile-cols-log2 -d "Specify the base 2 logarithm of the number of tile columns" -r
+complete -c kdynamicwallpaperbuilder -l chroma-subsampling -d "Specify the chroma subsampling" -x -a "444 422 420"
+complete -c kdynamicwallpaperbuilder -l codec -d "Specify the AV1 encoder" -x -a "auto aom rav1e svt"
+complete -c kdynamicwallpaperbuilder -l keyframe-interval -d "Specify the number of images between key frames" -r
+complete -c kdynamicwallpaperbuilder -l reorder -d "Encode the images in the order of their time of day"
+complete -c kdynamicwallpaperbuilder -l renditions -d "Specify the sizes of downscaled renditions to embed" -r
+complete -c kdynamicwallpaperbuilder -l cache-dir -d "Specify the directory where encoded images are cached" -x -a "(__fish_complete_directories)"
+complete -c kdynamicwallpaperbuilder -l no-cache -d "Do not cache encoded images"
+complete -c kdynamicwallpaperbuilder -l watch -d "Rebuild the wallpaper whenever an input file changes"
+complete -c kdynamicwallpaperbuilder -l images -d "Specify the indices of the images to keep when remuxing" -r
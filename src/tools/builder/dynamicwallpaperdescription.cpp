@@ -65,7 +65,8 @@ void DynamicWallpaperDescription::init(const QString &metaDataFileName)
 
     QMap<int, QString> uniqueFileNames;
     QList<KDynamicWallpaperMetaData> metaDataList;
-    QList<QImage> imageList;
+    QStringList imageFileNames;
+    bool hasImageIndices = false;
 
     for (int i = 0; i < descriptors.size(); ++i) {
         const QJsonObject descriptor = descriptors[i].toObject();
@@ -74,25 +75,39 @@ void DynamicWallpaperDescription::init(const QString &metaDataFileName)
         const QJsonValue crossFadeMode = descriptor[QLatin1String("CrossFade")];
         const QJsonValue time = descriptor[QLatin1String("Time")];
         const QJsonValue fileName = descriptor[QLatin1String("FileName")];
+        const QJsonValue imageIndex = descriptor[QLatin1String("Index")];
 
         QString absoluteFileName = fileName.toString();
+        int index = -1;
+
         if (absoluteFileName.isEmpty()) {
-            setError(QStringLiteral("FileName value was not specified for one or more of the images. Check your json file!"));
-            return;
-        }
+            // Descriptions of wallpapers that are being remuxed refer to existing images by index.
+            if (!imageIndex.isDouble() || imageIndex.toInt() < 0) {
+                setError(QStringLiteral("FileName value was not specified for one or more of the images. Check your json file!"));
+                return;
+            }
+            index = imageIndex.toInt();
+            absoluteFileName = QStringLiteral("#%1").arg(index);
+            hasImageIndices = true;
+        } else {
+            if (!QFileInfo(fileName.toString()).isAbsolute()) {
+                absoluteFileName = resolveFileName(fileName.toString());
+            }
 
-        if (!QFileInfo(fileName.toString()).isAbsolute()) {
-            absoluteFileName = resolveFileName(fileName.toString());
+            index = uniqueFileNames.key(absoluteFileName, -1);
+            if (index == -1) {
+                if (uniqueFileNames.isEmpty()) {
+                    index = 0;
+                } else {
+                    index = uniqueFileNames.lastKey() + 1;
+                }
+                uniqueFileNames.insert(index, absoluteFileName);
+            }
         }
 
-        int index = uniqueFileNames.key(absoluteFileName, -1);
-        if (index == -1) {
-            if (uniqueFileNames.isEmpty()) {
-                index = 0;
-            } else {
-                index = uniqueFileNames.lastKey() + 1;
-            }
-            uniqueFileNames.insert(index, absoluteFileName);
+        if (hasImageIndices && !uniqueFileNames.isEmpty()) {
+            setError(QStringLiteral("FileName and Index cannot be used in the same description file"));
+            return;
         }
 
         KDynamicWallpaperMetaData::MetaDataFields placeholderFields;
@@ -154,6 +169,11 @@ void DynamicWallpaperDescription::init(const QString &metaDataFileName)
             return;
         }
 
+        if (placeholderFields && hasImageIndices) {
+            setError(QStringLiteral("Placeholder values cannot be used for image ") + absoluteFileName);
+            return;
+        }
+
         if (placeholderFields) {
             DynamicWallpaperExifMetaData exifMetaData(absoluteFileName);
             if (placeholderFields & KDynamicWallpaperMetaData::SolarAzimuthField) {
@@ -191,10 +211,11 @@ void DynamicWallpaperDescription::init(const QString &metaDataFileName)
         metaDataList.append(metaData);
     }
 
+    // The images are loaded one at a time while the wallpaper is being written, only check
+    // that they can be read for now.
     for (const QString &fileName : uniqueFileNames) {
-        const QImage image(fileName);
-        if (!image.isNull()) {
-            imageList.append(image);
+        if (QImageReader(fileName).canRead()) {
+            imageFileNames.append(fileName);
         } else {
             setError(QStringLiteral("Failed to load ") + fileName);
             return;
@@ -202,7 +223,7 @@ void DynamicWallpaperDescription::init(const QString &metaDataFileName)
     }
 
     m_metaDataList = metaDataList;
-    m_imageList = imageList;
+    m_imageFileNames = imageFileNames;
 }
 
 void DynamicWallpaperDescription::setError(const QString &text)
@@ -231,9 +252,9 @@ QList<KDynamicWallpaperMetaData> DynamicWallpaperDescription::metaData() const
     return m_metaDataList;
 }
 
-QList<QImage> DynamicWallpaperDescription::images() const
+QStringList DynamicWallpaperDescription::imageFileNames() const
 {
-    return m_imageList;
+    return m_imageFileNames;
 }
 
 /*!
@@ -10,8 +10,8 @@
 
 #include <QJsonArray>
 #include <QJsonObject>
-#include <QImage>
 #include <QString>
+#include <QStringList>
 
 class DynamicWallpaperDescription
 {
@@ -20,7 +20,7 @@ public:
     ~DynamicWallpaperDescription();
 
     QList<KDynamicWallpaperMetaData> metaData() const;
-    QList<QImage> images() const;
+    QStringList imageFileNames() const;
 
     bool hasError() const;
     QString errorString() const;
@@ -30,7 +30,7 @@ private:
     void setError(const QString &text);
 
     QList<KDynamicWallpaperMetaData> m_metaDataList;
-    QList<QImage> m_imageList;
+    QStringList m_imageFileNames;
     QString m_errorString;
     bool m_hasError = false;
 };
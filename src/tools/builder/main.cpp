@@ -9,13 +9,274 @@
 #include <QCoreApplication>
 #include <QDebug>
 #include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QImage>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTimer>
 
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#include <KDynamicWallpaperEditor>
+#include <KDynamicWallpaperEncoderOptions>
 #include <KDynamicWallpaperMetaData>
 #include <KDynamicWallpaperWriter>
 #include <KLocalizedString>
 
 #include "dynamicwallpaperdescription.h"
 
+static bool parseIntegerOption(const QCommandLineParser &parser, const QCommandLineOption &option,
+                               int minimum, int maximum, int *value)
+{
+    if (!parser.isSet(option))
+        return true;
+
+    bool ok;
+    const int number = parser.value(option).toInt(&ok);
+    if (!ok || number < minimum || number > maximum) {
+        qWarning() << qPrintable(i18n("--%1 must be a number from %2 to %3",
+                                      option.names().first(), minimum, maximum));
+        return false;
+    }
+
+    *value = number;
+    return true;
+}
+
+static bool parseRenditionSizes(const QString &value, QVector<QSize> *sizes)
+{
+    const QStringList items = value.split(QLatin1Char(','));
+    for (const QString &item : items) {
+        const QStringList dimensions = item.trimmed().split(QLatin1Char('x'));
+        if (dimensions.count() != 2)
+            return false;
+
+        bool widthOk, heightOk;
+        const QSize size(dimensions[0].toInt(&widthOk), dimensions[1].toInt(&heightOk));
+        if (!widthOk || !heightOk || size.isEmpty())
+            return false;
+
+        sizes->append(size);
+    }
+
+    return true;
+}
+
+static bool parseEncoderOptions(const QCommandLineParser &parser,
+                                const QCommandLineOption &speedOption,
+                                const QCommandLineOption &minQuantizerOption,
+                                const QCommandLineOption &maxQuantizerOption,
+                                const QCommandLineOption &tileRowsOption,
+                                const QCommandLineOption &tileColumnsOption,
+                                const QCommandLineOption &chromaSubsamplingOption,
+                                const QCommandLineOption &codecOption,
+                                const QCommandLineOption &keyFrameIntervalOption,
+                                const QCommandLineOption &renditionsOption,
+                                KDynamicWallpaperEncoderOptions *options)
+{
+    int speed = options->speed();
+    int minQuantizer = options->minQuantizer();
+    int maxQuantizer = options->maxQuantizer();
+    int tileRowsLog2 = options->tileRowsLog2();
+    int tileColumnsLog2 = options->tileColumnsLog2();
+    int keyFrameInterval = options->keyFrameInterval();
+
+    if (!parseIntegerOption(parser, speedOption, KDynamicWallpaperEncoderOptions::MinSpeed,
+                            KDynamicWallpaperEncoderOptions::MaxSpeed, &speed))
+        return false;
+    if (!parseIntegerOption(parser, minQuantizerOption, KDynamicWallpaperEncoderOptions::MinQuantizer,
+                            KDynamicWallpaperEncoderOptions::MaxQuantizer, &minQuantizer))
+        return false;
+    if (!parseIntegerOption(parser, maxQuantizerOption, KDynamicWallpaperEncoderOptions::MinQuantizer,
+                            KDynamicWallpaperEncoderOptions::MaxQuantizer, &maxQuantizer))
+        return false;
+    if (!parseIntegerOption(parser, tileRowsOption, 0,
+                            KDynamicWallpaperEncoderOptions::MaxTilesLog2, &tileRowsLog2))
+        return false;
+    if (!parseIntegerOption(parser, tileColumnsOption, 0,
+                            KDynamicWallpaperEncoderOptions::MaxTilesLog2, &tileColumnsLog2))
+        return false;
+    if (!parseIntegerOption(parser, keyFrameIntervalOption, 0,
+                            std::numeric_limits<int>::max(), &keyFrameInterval))
+        return false;
+
+    // Raising only the maximum quantizer is the common way to trade quality for size.
+    if (parser.isSet(minQuantizerOption) && !parser.isSet(maxQuantizerOption))
+        maxQuantizer = std::max(minQuantizer, maxQuantizer);
+    if (minQuantizer > maxQuantizer) {
+        qWarning() << qPrintable(i18n("--min-quantizer must not be greater than --max-quantizer"));
+        return false;
+    }
+
+    options->setSpeed(speed);
+    options->setMinQuantizer(minQuantizer);
+    options->setMaxQuantizer(maxQuantizer);
+    options->setTileRowsLog2(tileRowsLog2);
+    options->setTileColumnsLog2(tileColumnsLog2);
+    options->setKeyFrameInterval(keyFrameInterval);
+
+    if (parser.isSet(chromaSubsamplingOption)) {
+        const QString subsampling = parser.value(chromaSubsamplingOption);
+        if (subsampling == QLatin1String("444")) {
+            options->setChromaSubsampling(KDynamicWallpaperEncoderOptions::Yuv444);
+        } else if (subsampling == QLatin1String("422")) {
+            options->setChromaSubsampling(KDynamicWallpaperEncoderOptions::Yuv422);
+        } else if (subsampling == QLatin1String("420")) {
+            options->setChromaSubsampling(KDynamicWallpaperEncoderOptions::Yuv420);
+        } else {
+            qWarning() << qPrintable(i18n("Unknown chroma subsampling: %1", subsampling));
+            return false;
+        }
+    }
+
+    if (parser.isSet(codecOption)) {
+        const QString codec = parser.value(codecOption);
+        if (codec == QLatin1String("auto")) {
+            options->setCodec(KDynamicWallpaperEncoderOptions::AutomaticCodec);
+        } else if (codec == QLatin1String("aom")) {
+            options->setCodec(KDynamicWallpaperEncoderOptions::AomCodec);
+        } else if (codec == QLatin1String("rav1e")) {
+            options->setCodec(KDynamicWallpaperEncoderOptions::Rav1eCodec);
+        } else if (codec == QLatin1String("svt")) {
+            options->setCodec(KDynamicWallpaperEncoderOptions::SvtCodec);
+        } else {
+            qWarning() << qPrintable(i18n("Unknown codec: %1", codec));
+            return false;
+        }
+    }
+
+    if (parser.isSet(renditionsOption)) {
+        QVector<QSize> renditionSizes;
+        if (!parseRenditionSizes(parser.value(renditionsOption), &renditionSizes)) {
+            qWarning() << qPrintable(i18n("--renditions must be a comma-separated list of sizes, e.g. 1280x720,640x360"));
+            return false;
+        }
+        options->setRenditionSizes(renditionSizes);
+    }
+
+    return true;
+}
+
+// Editors tend to touch files several times when saving them, wait for things to settle down.
+static const int s_rebuildDelay = 500;
+
+static bool build(const QString &descriptionFileName, const QString &targetFileName,
+                  const KDynamicWallpaperEncoderOptions &encoderOptions,
+                  const QString &cacheDirectory, bool reorder, QStringList *inputFileNames)
+{
+    DynamicWallpaperDescription description(descriptionFileName);
+    if (description.hasError()) {
+        qWarning() << qPrintable(description.errorString());
+        return false;
+    }
+
+    const QStringList imageFileNames = description.imageFileNames();
+    if (imageFileNames.isEmpty()) {
+        qWarning() << qPrintable(i18n("Images can be referred to by Index only when remuxing a wallpaper"));
+        return false;
+    }
+    *inputFileNames = imageFileNames;
+
+    QList<KDynamicWallpaperMetaData> metaData = description.metaData();
+    QVector<int> imageOrder(imageFileNames.count());
+    std::iota(imageOrder.begin(), imageOrder.end(), 0);
+
+    // Images that are close in time usually look alike. Encoding them in the order of their
+    // time of day lets the encoder predict every image from a similar one.
+    if (reorder) {
+        QVector<qreal> imageTimes(imageFileNames.count(), 1.0);
+        for (const KDynamicWallpaperMetaData &md : qAsConst(metaData))
+            imageTimes[md.index()] = std::min(imageTimes[md.index()], md.time());
+
+        std::stable_sort(imageOrder.begin(), imageOrder.end(), [&imageTimes](int a, int b) {
+            return imageTimes[a] < imageTimes[b];
+        });
+
+        QVector<int> newIndices(imageOrder.count());
+        for (int i = 0; i < imageOrder.count(); ++i)
+            newIndices[imageOrder[i]] = i;
+        for (KDynamicWallpaperMetaData &md : metaData)
+            md.setIndex(newIndices[md.index()]);
+    }
+
+    // The previous wallpaper is kept around until the new one has been written successfully.
+    QSaveFile file(targetFileName);
+
+    // Feed the images to the writer one by one so only a few of them are in memory at a time.
+    KDynamicWallpaperWriter writer;
+    writer.setEncoderOptions(encoderOptions);
+    writer.setCacheDirectory(cacheDirectory);
+    bool ok = writer.begin(&file);
+
+    for (int i = 0; ok && i < imageOrder.count(); ++i)
+        ok = writer.addImageFile(imageFileNames[imageOrder[i]]);
+
+    for (const KDynamicWallpaperMetaData &md : qAsConst(metaData))
+        writer.addMetaData(md);
+
+    if (!ok || !writer.finish()) {
+        qWarning() << writer.errorString();
+        file.cancelWriting();
+        return false;
+    }
+
+    if (!file.commit()) {
+        qWarning() << file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+static bool remux(const QString &wallpaperFileName, const QString &descriptionFileName,
+                  const QString &imageList, const QString &targetFileName)
+{
+    KDynamicWallpaperEditor editor;
+    if (!editor.load(wallpaperFileName)) {
+        qWarning() << editor.errorString();
+        return false;
+    }
+
+    if (!imageList.isEmpty()) {
+        QVector<int> imageIndices;
+        const QStringList items = imageList.split(QLatin1Char(','));
+        for (const QString &item : items) {
+            bool ok;
+            imageIndices.append(item.trimmed().toInt(&ok));
+            if (!ok) {
+                qWarning() << qPrintable(i18n("Invalid image index: %1", item));
+                return false;
+            }
+        }
+        if (!editor.setImageOrder(imageIndices)) {
+            qWarning() << editor.errorString();
+            return false;
+        }
+    }
+
+    if (!descriptionFileName.isEmpty()) {
+        DynamicWallpaperDescription description(descriptionFileName);
+        if (description.hasError()) {
+            qWarning() << qPrintable(description.errorString());
+            return false;
+        }
+        if (!description.imageFileNames().isEmpty()) {
+            qWarning() << qPrintable(i18n("Images must be referred to by Index when remuxing a wallpaper"));
+            return false;
+        }
+        editor.setMetaData(description.metaData());
+    }
+
+    if (!editor.save(targetFileName)) {
+        qWarning() << editor.errorString();
+        return false;
+    }
+
+    return true;
+}
+
 int main(int argc, char **argv)
 {
     QCoreApplication app(argc, argv);
@@ -26,36 +287,155 @@ int main(int argc, char **argv)
     outputOption.setDescription(i18n("Write output to <file>"));
     outputOption.setValueName(QStringLiteral("file"));
 
+    QCommandLineOption speedOption(QStringLiteral("speed"));
+    speedOption.setDescription(i18n("Encoder speed preset, from 0 (slowest) to 10 (fastest)"));
+    speedOption.setValueName(QStringLiteral("speed"));
+
+    QCommandLineOption minQuantizerOption(QStringLiteral("min-quantizer"));
+    minQuantizerOption.setDescription(i18n("Minimum quantizer, from 0 (lossless) to 63 (worst quality)"));
+    minQuantizerOption.setValueName(QStringLiteral("quantizer"));
+
+    QCommandLineOption maxQuantizerOption(QStringLiteral("max-quantizer"));
+    maxQuantizerOption.setDescription(i18n("Maximum quantizer, from 0 (lossless) to 63 (worst quality)"));
+    maxQuantizerOption.setValueName(QStringLiteral("quantizer"));
+
+    QCommandLineOption tileRowsOption(QStringLiteral("tile-rows-log2"));
+    tileRowsOption.setDescription(i18n("Base 2 logarithm of the number of tile rows, from 0 to 6"));
+    tileRowsOption.setValueName(QStringLiteral("log2"));
+
+    QCommandLineOption tileColumnsOption(QStringLiteral("tile-cols-log2"));
+    tileColumnsOption.setDescription(i18n("Base 2 logarithm of the number of tile columns, from 0 to 6"));
+    tileColumnsOption.setValueName(QStringLiteral("log2"));
+
+    QCommandLineOption chromaSubsamplingOption(QStringLiteral("chroma-subsampling"));
+    chromaSubsamplingOption.setDescription(i18n("Chroma subsampling: 444, 422 or 420"));
+    chromaSubsamplingOption.setValueName(QStringLiteral("format"));
+
+    QCommandLineOption codecOption(QStringLiteral("codec"));
+    codecOption.setDescription(i18n("AV1 encoder to use: auto, aom, rav1e or svt"));
+    codecOption.setValueName(QStringLiteral("codec"));
+
+    QCommandLineOption keyFrameIntervalOption(QStringLiteral("keyframe-interval"));
+    keyFrameIntervalOption.setDescription(i18n("Number of images between key frames, 0 makes only the first image a key frame"));
+    keyFrameIntervalOption.setValueName(QStringLiteral("interval"));
+
+    QCommandLineOption reorderOption(QStringLiteral("reorder"));
+    reorderOption.setDescription(i18n("Encode the images in the order of their time of day"));
+
+    QCommandLineOption renditionsOption(QStringLiteral("renditions"));
+    renditionsOption.setDescription(i18n("Comma-separated sizes of downscaled renditions to embed, e.g. 1280x720,640x360"));
+    renditionsOption.setValueName(QStringLiteral("sizes"));
+
+    QCommandLineOption cacheDirectoryOption(QStringLiteral("cache-dir"));
+    cacheDirectoryOption.setDescription(i18n("Cache encoded images in <directory>"));
+    cacheDirectoryOption.setValueName(QStringLiteral("directory"));
+
+    QCommandLineOption noCacheOption(QStringLiteral("no-cache"));
+    noCacheOption.setDescription(i18n("Do not cache encoded images"));
+
+    QCommandLineOption watchOption(QStringLiteral("watch"));
+    watchOption.setDescription(i18n("Rebuild the wallpaper whenever the description file or an image changes"));
+
+    QCommandLineOption imagesOption(QStringLiteral("images"));
+    imagesOption.setDescription(i18n("Comma-separated indices of the images to keep when remuxing"));
+    imagesOption.setValueName(QStringLiteral("indices"));
+
     QCommandLineParser parser;
+    parser.setApplicationDescription(i18n("Builds a dynamic wallpaper from a description file, or, with "
+                                          "\"remux <wallpaper> [json]\", replaces the metadata of an "
+                                          "existing wallpaper and rearranges its images without "
+                                          "encoding them again."));
     parser.addHelpOption();
     parser.addVersionOption();
     parser.addPositionalArgument("json", i18n("Description file to use"));
     parser.addOption(outputOption);
+    parser.addOption(speedOption);
+    parser.addOption(minQuantizerOption);
+    parser.addOption(maxQuantizerOption);
+    parser.addOption(tileRowsOption);
+    parser.addOption(tileColumnsOption);
+    parser.addOption(chromaSubsamplingOption);
+    parser.addOption(codecOption);
+    parser.addOption(keyFrameIntervalOption);
+    parser.addOption(reorderOption);
+    parser.addOption(renditionsOption);
+    parser.addOption(cacheDirectoryOption);
+    parser.addOption(noCacheOption);
+    parser.addOption(watchOption);
+    parser.addOption(imagesOption);
     parser.process(app);
 
-    if (parser.positionalArguments().count() != 1)
+    const QStringList positionalArguments = parser.positionalArguments();
+    if (positionalArguments.value(0) == QLatin1String("remux")) {
+        if (positionalArguments.count() < 2 || positionalArguments.count() > 3)
+            parser.showHelp(-1);
+
+        // Unlike building, remuxing edits the wallpaper in place unless told otherwise.
+        QString targetFileName = parser.value(outputOption);
+        if (targetFileName.isEmpty())
+            targetFileName = positionalArguments[1];
+
+        if (!remux(positionalArguments[1], positionalArguments.value(2), parser.value(imagesOption), targetFileName))
+            return -1;
+        return 0;
+    }
+
+    if (positionalArguments.count() != 1)
         parser.showHelp(-1);
 
-    DynamicWallpaperDescription description(parser.positionalArguments().first());
-    if (description.hasError()) {
-        if (description.hasError())
-            qWarning() << qPrintable(description.errorString());
+    KDynamicWallpaperEncoderOptions encoderOptions;
+    if (!parseEncoderOptions(parser, speedOption, minQuantizerOption, maxQuantizerOption,
+                             tileRowsOption, tileColumnsOption, chromaSubsamplingOption,
+                             codecOption, keyFrameIntervalOption, renditionsOption, &encoderOptions))
         return -1;
-    }
 
-    KDynamicWallpaperWriter writer;
-    writer.setImages(description.images());
-    writer.setMetaData(description.metaData());
+    const QString descriptionFileName = positionalArguments.first();
 
     QString targetFileName = parser.value(outputOption);
     if (targetFileName.isEmpty())
         targetFileName = QStringLiteral("wallpaper.avif");
 
-    if (!writer.flush(targetFileName)) {
-        qWarning() << writer.errorString();
-        QFile::remove(targetFileName);
-        return -1;
+    QString cacheDirectory;
+    if (!parser.isSet(noCacheOption)) {
+        cacheDirectory = parser.value(cacheDirectoryOption);
+        if (cacheDirectory.isEmpty())
+            cacheDirectory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    }
+
+    const bool reorder = parser.isSet(reorderOption);
+
+    if (!parser.isSet(watchOption)) {
+        QStringList inputFileNames;
+        if (!build(descriptionFileName, targetFileName, encoderOptions, cacheDirectory, reorder, &inputFileNames))
+            return -1;
+        return 0;
     }
 
-    return 0;
+    QFileSystemWatcher watcher;
+
+    QTimer rebuildTimer;
+    rebuildTimer.setSingleShot(true);
+    rebuildTimer.setInterval(s_rebuildDelay);
+
+    auto rebuild = [&]() {
+        QStringList inputFileNames;
+        if (build(descriptionFileName, targetFileName, encoderOptions, cacheDirectory, reorder, &inputFileNames))
+            qInfo() << qPrintable(i18n("Wrote %1", targetFileName));
+
+        // Files that are replaced rather than modified in place drop out of the watcher, and
+        // the description may refer to other images now, so start over with the watched files.
+        inputFileNames.prepend(descriptionFileName);
+        const QStringList watchedFileNames = watcher.files();
+        if (!watchedFileNames.isEmpty())
+            watcher.removePaths(watchedFileNames);
+        watcher.addPaths(inputFileNames);
+    };
+
+    QObject::connect(&watcher, &QFileSystemWatcher::fileChanged, &rebuildTimer, qOverload<>(&QTimer::start));
+    QObject::connect(&rebuildTimer, &QTimer::timeout, rebuild);
+
+    rebuild();
+    qInfo() << qPrintable(i18n("Watching %1 for changes", descriptionFileName));
+
+    return app.exec();
 }